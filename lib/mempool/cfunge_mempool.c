@@ -90,3 +90,10 @@ Notes:
 #  define CF_MEMPOOL_DATATYPE struct s_instructionPointer
 #  include "cfunge_mempool_priv.h"
 #endif
+
+#undef CF_MEMPOOL_VARIANT
+#undef CF_MEMPOOL_DATATYPE
+
+#define CF_MEMPOOL_VARIANT  stack
+#define CF_MEMPOOL_DATATYPE struct funge_stack
+#include "cfunge_mempool_priv.h"
@@ -26,6 +26,7 @@
  *  * Hash Funge-space s_hash_entry.
  *  * Hash Funge-space bounds array s_hash_entry. (Compile time option.)
  *  * IPs for concurrent funge. (Compile time option.)
+ *  * Stacks.
  * Since cfunge is single-threaded they are static, and have no locking.
  *
  * For implementation details see comments in cfunge_mempool.c.
@@ -40,13 +41,14 @@
 
 #include "../../src/global.h"
 
-/* CFUNGE_MEMPOOL_HASHLIB and CFUNGE_MEMPOOL_IPS selects which mempools
- * we want to define prototypes for. CFUNGE_MEMPOOL_INTERNAL is used by
- * the mempool implementation file to enable all of them.
+/* CFUNGE_MEMPOOL_HASHLIB, CFUNGE_MEMPOOL_IPS and CFUNGE_MEMPOOL_STACKS select
+ * which mempools we want to define prototypes for. CFUNGE_MEMPOOL_INTERNAL is
+ * used by the mempool implementation file to enable all of them.
  */
 #ifdef CFUNGE_MEMPOOL_INTERNAL
 #  define CFUNGE_MEMPOOL_HASHLIB
 #  define CFUNGE_MEMPOOL_IPS
+#  define CFUNGE_MEMPOOL_STACKS
 #endif
 
 #ifdef CFUNGE_MEMPOOL_HASHLIB
@@ -58,6 +60,10 @@
 #  include "../../src/ip.h"
 #endif
 
+#ifdef CFUNGE_MEMPOOL_STACKS
+#  include "../../src/stack.h"
+#endif
+
 #define CF_MEMPOOL_FUNCPROT(m_variant, m_rettype, m_funcname, m_args, m_attrs) \
 	m_attrs m_rettype cf_mempool_ ## m_variant ## _ ## m_funcname m_args
 
@@ -114,6 +120,10 @@ CF_MEMPOOL_DECLARE_FUNCS(fspacecount, struct s_fspacecount_hash_entry)
 CF_MEMPOOL_DECLARE_FUNCS(ip, struct s_instructionPointer)
 #endif
 
+#ifdef CFUNGE_MEMPOOL_STACKS
+CF_MEMPOOL_DECLARE_FUNCS(stack, struct funge_stack)
+#endif
+
 // Cleanup our macros.
 #undef CF_MEMPOOL_FUNCPROT
 #undef CF_MEMPOOL_DECLARE_FUNCS
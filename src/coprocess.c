@@ -0,0 +1,250 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "coprocess.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/// Pipe ends are moved to at least this number before spawning, so they can't
+/// collide with the numbers they are moved to in the child.
+#define COPROCESS_HIGH_FD 10
+
+/// Spawned processes get the default SIGPIPE handler back, we ignore it.
+FUNGE_ATTR_FAST
+static bool coprocess_attr_init(posix_spawnattr_t * restrict attr)
+{
+	sigset_t sigdef;
+
+	if (posix_spawnattr_init(attr) != 0)
+		return false;
+	sigemptyset(&sigdef);
+	sigaddset(&sigdef, SIGPIPE);
+	if (posix_spawnattr_setsigdefault(attr, &sigdef) != 0
+	    || posix_spawnattr_setflags(attr, POSIX_SPAWN_SETSIGDEF) != 0) {
+		posix_spawnattr_destroy(attr);
+		return false;
+	}
+	return true;
+}
+
+FUNGE_ATTR_FAST
+static pid_t coprocess_do_spawn(const char * restrict path, char * const argv[],
+                                const posix_spawn_file_actions_t * actions)
+{
+	posix_spawnattr_t attr;
+	pid_t pid;
+	int err;
+
+	if (!coprocess_attr_init(&attr))
+		return -1;
+	if (strchr(path, '/'))
+		err = posix_spawn(&pid, path, actions, &attr, argv, environ);
+	else
+		err = posix_spawnp(&pid, path, actions, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0) {
+		errno = err;
+		return -1;
+	}
+	return pid;
+}
+
+FUNGE_ATTR_FAST pid_t
+coprocess_spawn(const char * restrict path, char * const argv[])
+{
+	return coprocess_do_spawn(path, argv, NULL);
+}
+
+/// Replace fd with a close-on-exec copy numbered COPROCESS_HIGH_FD or above.
+FUNGE_ATTR_FAST
+static int coprocess_move_high(int fd)
+{
+	int high = fcntl(fd, F_DUPFD, COPROCESS_HIGH_FD);
+	close(fd);
+	if (high != -1)
+		fcntl(high, F_SETFD, FD_CLOEXEC);
+	return high;
+}
+
+FUNGE_ATTR_FAST pid_t
+coprocess_spawn_redirect(const char * restrict path, char * const argv[], int fd, int source)
+{
+	posix_spawn_file_actions_t actions;
+	pid_t pid = -1;
+
+	if (posix_spawn_file_actions_init(&actions) != 0)
+		return -1;
+	if (posix_spawn_file_actions_adddup2(&actions, source, fd) == 0)
+		pid = coprocess_do_spawn(path, argv, &actions);
+	posix_spawn_file_actions_destroy(&actions);
+	return pid;
+}
+
+FUNGE_ATTR_FAST bool
+coprocess_pipe(int fds[2])
+{
+	if (pipe(fds) == -1)
+		return false;
+	fds[0] = coprocess_move_high(fds[0]);
+	fds[1] = coprocess_move_high(fds[1]);
+	if (fds[0] != -1 && fds[1] != -1)
+		return true;
+	if (fds[0] != -1)
+		close(fds[0]);
+	if (fds[1] != -1)
+		close(fds[1]);
+	return false;
+}
+
+FUNGE_ATTR_FAST bool
+coprocess_start(coprocess * restrict cp, const char * restrict path,
+                char * const argv[], int requestfd, int resultfd, int stdinfd)
+{
+	posix_spawn_file_actions_t actions;
+	int requestfds[2], resultfds[2];
+	bool ok;
+
+	assert(cp->pid == -1);
+
+	if (pipe(requestfds) == -1)
+		return false;
+	if (pipe(resultfds) == -1) {
+		close(requestfds[0]);
+		close(requestfds[1]);
+		return false;
+	}
+	for (size_t i = 0; i < 2; i++) {
+		requestfds[i] = coprocess_move_high(requestfds[i]);
+		resultfds[i] = coprocess_move_high(resultfds[i]);
+	}
+	ok = requestfds[0] != -1 && requestfds[1] != -1
+	     && resultfds[0] != -1 && resultfds[1] != -1;
+
+	if (ok && posix_spawn_file_actions_init(&actions) == 0) {
+		// Order matters: stdin must be copied before requestfd may replace it.
+		// dup2() clears close-on-exec on the new descriptors.
+		ok = (stdinfd == -1 || posix_spawn_file_actions_adddup2(&actions, 0, stdinfd) == 0)
+		     && posix_spawn_file_actions_adddup2(&actions, requestfds[0], requestfd) == 0
+		     && posix_spawn_file_actions_adddup2(&actions, resultfds[1], resultfd) == 0;
+		if (ok)
+			cp->pid = coprocess_do_spawn(path, argv, &actions);
+		posix_spawn_file_actions_destroy(&actions);
+	} else {
+		ok = false;
+	}
+	ok = ok && cp->pid != -1;
+
+	if (requestfds[0] != -1)
+		close(requestfds[0]);
+	if (resultfds[1] != -1)
+		close(resultfds[1]);
+	if (ok) {
+		cp->request = requestfds[1];
+		cp->result = fdopen(resultfds[0], "rb");
+		if (cp->result)
+			return true;
+		coprocess_stop(cp);
+		close(resultfds[0]);
+		return false;
+	}
+	if (requestfds[1] != -1)
+		close(requestfds[1]);
+	if (resultfds[0] != -1)
+		close(resultfds[0]);
+	return false;
+}
+
+FUNGE_ATTR_FAST void
+coprocess_stop(coprocess * restrict cp)
+{
+	if (cp->pid == -1)
+		return;
+	if (cp->request != -1)
+		close(cp->request);
+	if (cp->result)
+		fclose(cp->result);
+	cp->request = -1;
+	cp->result = NULL;
+	// Closing the request pipe makes a healthy process exit on its own, this
+	// is for one stuck in whatever it was asked to do.
+	kill(cp->pid, SIGKILL);
+	while (waitpid(cp->pid, NULL, 0) == -1 && errno == EINTR)
+		;
+	cp->pid = -1;
+}
+
+FUNGE_ATTR_FAST bool
+coprocess_alive(coprocess * restrict cp)
+{
+	if (cp->pid == -1)
+		return false;
+	if (waitpid(cp->pid, NULL, WNOHANG) == 0)
+		return true;
+	// Already reaped, don't let coprocess_stop() kill or wait for it.
+	cp->pid = -1;
+	close(cp->request);
+	fclose(cp->result);
+	cp->request = -1;
+	cp->result = NULL;
+	return false;
+}
+
+FUNGE_ATTR_FAST bool
+coprocess_send(coprocess * restrict cp, const char * restrict buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(cp->request, buf, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+FUNGE_ATTR_FAST bool
+coprocess_read_number(coprocess * restrict cp, unsigned long * restrict value)
+{
+	unsigned long n = 0;
+	int c;
+
+	while ((c = getc(cp->result)) != '\n') {
+		if (c < '0' || c > '9' || n > (ULONG_MAX - 9) / 10)
+			return false;
+		n = n * 10 + (unsigned long)(c - '0');
+	}
+	*value = n;
+	return true;
+}
@@ -0,0 +1,117 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Long-running helper processes (-C option).
+ *
+ * Used by PERL and = to avoid starting a new process for each call. The
+ * helper gets a pipe to read requests from and a pipe to write results to,
+ * the rest of the protocol is up to the caller. Processes are started with
+ * posix_spawn(), so the cost doesn't depend on how much memory the
+ * interpreter has mapped.
+ */
+
+#ifndef FUNGE_HAD_SRC_COPROCESS_H
+#define FUNGE_HAD_SRC_COPROCESS_H
+
+#include "global.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef struct coprocess {
+	pid_t  pid;     ///< -1 when not running.
+	int    request; ///< We write requests here.
+	FILE * result;  ///< And read results from here.
+} coprocess;
+
+#define COPROCESS_INIT { -1, -1, NULL }
+
+/**
+ * Start a process without forking the interpreter.
+ * @param cp Where to store the handles. Must not be running.
+ * @param path Program to run, looked up in PATH if it contains no slash.
+ * @param argv Arguments, including argv[0].
+ * @param requestfd File descriptor the child reads requests from.
+ * @param resultfd File descriptor the child writes results to.
+ * @param stdinfd If not -1, the child gets a copy of our stdin here. Useful
+ * when requestfd is 0.
+ * @return True if the process was started.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool coprocess_start(coprocess * restrict cp, const char * restrict path,
+                     char * const argv[], int requestfd, int resultfd, int stdinfd);
+
+/**
+ * Close the pipes and kill the process if it is still running.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void coprocess_stop(coprocess * restrict cp);
+
+/**
+ * Check if the process is still running, and clean up if it isn't.
+ * @return True if running.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+bool coprocess_alive(coprocess * restrict cp);
+
+/**
+ * Write a whole request.
+ * @return False if the process went away (the request was then not seen).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool coprocess_send(coprocess * restrict cp, const char * restrict buf, size_t len);
+
+/**
+ * Read a decimal number terminated by a newline from the result pipe.
+ * @return False on EOF or anything unexpected.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool coprocess_read_number(coprocess * restrict cp, unsigned long * restrict value);
+
+/**
+ * Spawn a process with the same settings as coprocess_start() uses, but with
+ * standard file descriptors only.
+ * @return Process ID or -1 on error (errno is set).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+pid_t coprocess_spawn(const char * restrict path, char * const argv[]);
+
+/**
+ * Like coprocess_spawn(), but the child gets a copy of source as fd.
+ * @return Process ID or -1 on error (errno is set).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+pid_t coprocess_spawn_redirect(const char * restrict path, char * const argv[], int fd, int source);
+
+/**
+ * Create a pipe whose ends are close-on-exec and numbered high enough to not
+ * collide with the standard file descriptors, for use with
+ * coprocess_spawn_redirect().
+ * @return False on error (errno is set).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool coprocess_pipe(int fds[2]);
+
+#endif
@@ -24,6 +24,7 @@
 #if !defined(CFUN_NO_FLOATS)
 #include "../../stack.h"
 #include "../../input.h"
+#include "../../output.h"
 
 #include <stdio.h>
 #include <math.h>
@@ -32,7 +33,7 @@ FUNGE_ATTR_FAST static void binary(funge_cell number)
 {
 	if (number > 0) {
 		binary(number >> 1);
-		cf_putchar_unlocked((number & 1) ? '1' : '0');
+		(void)output_putchar((number & 1) ? '1' : '0');
 	}
 }
 
@@ -41,21 +42,21 @@ static void finger_BASE_output_binary(instructionPointer * ip)
 	funge_cell x;
 	x = stack_pop(ip->stack);
 	binary(x);
-	cf_putchar_unlocked(' ');
+	(void)output_putchar(' ');
 }
 
 static void finger_BASE_output_octal(instructionPointer * ip)
 {
 	funge_cell x;
 	x = stack_pop(ip->stack);
-	printf("%" FUNGECELLoctPRI " ", (funge_unsigned_cell)x);
+	(void)output_printf("%" FUNGECELLoctPRI " ", (funge_unsigned_cell)x);
 }
 
 static void finger_BASE_output_hex(instructionPointer * ip)
 {
 	funge_cell x;
 	x = stack_pop(ip->stack);
-	printf("%" FUNGECELLhexPRI " ", (funge_unsigned_cell)x);
+	(void)output_printf("%" FUNGECELLhexPRI " ", (funge_unsigned_cell)x);
 }
 
 #define anyLog(base, value) (log(value)/log(base))
@@ -75,10 +76,10 @@ static void finger_BASE_output_base(instructionPointer * ip)
 
 	if (base == 1) {
 		while (val--)
-			cf_putchar_unlocked('0');
-		cf_putchar_unlocked(' ');
+			(void)output_putchar('0');
+		(void)output_putchar(' ');
 	} else if (!val) {
-		cf_putchar_unlocked('0');
+		(void)output_putchar('0');
 	} else {
 		// We need at most this size of the string.
 		size_t i = ceil(anyLog((double)base, (double)val) + 1);
@@ -87,8 +88,8 @@ static void finger_BASE_output_base(instructionPointer * ip)
 		for (i = 0; val > 0; val /= base)
 			result[i++] = digits[val % base];
 		for (; i-- > 0;)
-			cf_putchar_unlocked(result[i]);
-		cf_putchar_unlocked(' ');
+			(void)output_putchar(result[i]);
+		(void)output_putchar(' ');
 	}
 }
 
@@ -104,7 +105,7 @@ static void finger_BASE_input_base(instructionPointer * ip)
 		return;
 	}
 
-	fflush(stdout);
+	(void)output_flush();
 
 	while (gotint == rgi_noint) {
 		gotint = input_getint(&a, (int)base);
@@ -23,6 +23,7 @@
 
 #if !defined(CFUN_NO_FLOATS)
 #include "../../stack.h"
+#include "../../output.h"
 #include "../../division.h"
 
 #include <math.h>
@@ -74,10 +75,8 @@ static void finger_CPLI_out(instructionPointer * ip)
 	funge_cell r, i;
 	i = stack_pop(ip->stack);
 	r = stack_pop(ip->stack);
-	printf("%" FUNGECELLPRI, r);
-	if (i > 0)
-		cf_putchar_unlocked('+');
-	printf("%" FUNGECELLPRI "i ", i);
+	(void)output_printf("%" FUNGECELLPRI "%s%" FUNGECELLPRI "i ",
+	                    r, (i > 0) ? "+" : "", i);
 }
 
 /// S - sub
@@ -22,7 +22,6 @@
 #include "FILE.h"
 #include "../../stack.h"
 #include "../../../lib/stringbuffer/stringbuffer.h"
-#include "../../diagnostic.h"
 
 #include <assert.h>
 #include <stdio.h> /* fclose, fopen, fread, fwrite ... */
@@ -127,12 +126,10 @@ static void finger_FILE_delete(instructionPointer * ip)
 {
 	char * restrict filename;
 
-	filename = (char*)stack_pop_string(ip->stack, NULL);
+	filename = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (!filename || (unlink(filename) != 0)) {
 		ip_reverse(ip);
 	}
-
-	stack_free_string(filename);
 }
 
 
@@ -243,7 +240,7 @@ static void finger_FILE_fopen(instructionPointer * ip)
 	funge_vector vect;
 	funge_cell h;
 
-	filename = (char*)stack_pop_string(ip->stack, NULL);
+	filename = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (FUNGE_UNLIKELY(!filename))
 		goto error;
 	mode = stack_pop(ip->stack);
@@ -275,12 +272,10 @@ static void finger_FILE_fopen(instructionPointer * ip)
 
 	handles[h]->buffvect = vect;
 	stack_push(ip->stack, h);
-	goto end;
+	return;
 // Look... The alternatives to the goto were worse...
 error:
 	ip_reverse(ip);
-end:
-	stack_free_string(filename);
 }
 
 /// P - Put string to file (like c fputs)
@@ -289,7 +284,7 @@ static void finger_FILE_fputs(instructionPointer * ip)
 	char * restrict str;
 	funge_cell h;
 
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	h = stack_peek(ip->stack);
 	if (!valid_handle(h) || !str) {
 		ip_reverse(ip);
@@ -299,7 +294,6 @@ static void finger_FILE_fputs(instructionPointer * ip)
 			ip_reverse(ip);
 		}
 	}
-	stack_free_string(str);
 }
 
 /// R - Read n bytes from file to i/o buffer
@@ -320,31 +314,28 @@ static void finger_FILE_fread(instructionPointer * ip)
 		return;
 	}
 	{
-		size_t bytes_read;
 		FILE * fp = handles[h]->file;
-		unsigned char * restrict buf = malloc((size_t)n * sizeof(unsigned char));
-		if (!buf) {
-			ip_reverse(ip);
-			return;
-		}
+		funge_vector v = handles[h]->buffvect;
+		unsigned char buf[FUNGESPACE_TILE_SIZE];
+		size_t left = (size_t)n;
 
-		if ((bytes_read = fread(buf, sizeof(unsigned char), (size_t)n, fp)) != (size_t)n) {
-			// Reverse on less bytes read, but if feof() also write out to funge space below.
-			ip_reverse(ip);
-			if (ferror(fp)) {
+		while (left > 0) {
+			size_t want = left < sizeof(buf) ? left : sizeof(buf);
+			size_t bytes_read = fread(buf, sizeof(unsigned char), want, fp);
+			if (bytes_read != want && ferror(fp)) {
 				clearerr(fp);
-				free(buf);
+				ip_reverse(ip);
 				return;
 			}
-		}
-		{
-			funge_vector v = handles[h]->buffvect;
-			for (size_t i = 0; i < bytes_read; i++) {
-				fungespace_set(buf[i], &v);
-				v.x++;
+			fungespace_set_bytes(buf, bytes_read, &v);
+			v.x += (funge_cell)bytes_read;
+			left -= bytes_read;
+			// Reverse on less bytes read, but still keep what we got.
+			if (bytes_read != want) {
+				ip_reverse(ip);
+				return;
 			}
 		}
-		free(buf);
 	}
 }
 
@@ -406,20 +397,22 @@ static void finger_FILE_fwrite(instructionPointer * ip)
 	{
 		FILE * fp = handles[h]->file;
 		funge_vector v = handles[h]->buffvect;
-		unsigned char * restrict buf = malloc((size_t)n * sizeof(unsigned char));
-		if (FUNGE_UNLIKELY(!buf))
-			DIAG_OOM("Failed to allocate buffer");
-		for (funge_cell i = 0; i < n; i++) {
-			buf[i] = (unsigned char)fungespace_get(&v);
-			v.x++;
-		}
-		if (fwrite(buf, sizeof(unsigned char), (size_t)n, fp) != (size_t)n) {
-			if (ferror(fp)) {
-				clearerr(fp);
-				ip_reverse(ip);
+		unsigned char buf[FUNGESPACE_TILE_SIZE];
+		size_t left = (size_t)n;
+
+		while (left > 0) {
+			size_t want = left < sizeof(buf) ? left : sizeof(buf);
+			fungespace_get_bytes(buf, want, &v);
+			if (fwrite(buf, sizeof(unsigned char), want, fp) != want) {
+				if (ferror(fp)) {
+					clearerr(fp);
+					ip_reverse(ip);
+				}
+				return;
 			}
+			v.x += (funge_cell)want;
+			left -= want;
 		}
-		free(buf);
 	}
 }
 
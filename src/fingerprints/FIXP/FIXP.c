@@ -99,7 +99,7 @@ static void finger_FIXP_rand(instructionPointer * ip)
 	if (n == 0)
 		stack_push(ip->stack, 0);
 	else
-		stack_push(ip->stack, (funge_cell)prng_generate_unsigned(n));
+		stack_push(ip->stack, (funge_cell)prng_generate_unsigned(&ip->prng, (funge_unsigned_cell)n));
 }
 
 /// I - sin
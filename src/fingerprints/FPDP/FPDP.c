@@ -23,6 +23,7 @@
 
 #if !defined(CFUN_NO_FLOATS)
 #include "../../stack.h"
+#include "../../output.h"
 
 #include <math.h>
 #include <stdlib.h> /* strtod */
@@ -210,20 +211,19 @@ static void finger_FPDP_toint(instructionPointer * ip)
 static void finger_FPDP_fromascii(instructionPointer * ip)
 {
 	char * restrict str;
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (FUNGE_UNLIKELY(!str)) {
 		ip_reverse(ip);
 		return;
 	}
 	u.d = strtod(str, NULL);
 	pushDbl(ip);
-	stack_free_string(str);
 }
 
 static void finger_FPDP_print(instructionPointer * ip)
 {
 	popDbl(ip);
-	printf("%f ", u.d);
+	(void)output_printf("%f ", u.d);
 }
 
 bool finger_FPDP_load(instructionPointer * ip)
@@ -23,6 +23,7 @@
 
 #if !defined(CFUN_NO_FLOATS)
 #include "../../stack.h"
+#include "../../output.h"
 
 #include <math.h>
 #include <stdlib.h> /* strtof */
@@ -211,21 +212,20 @@ static void finger_FPSP_fromascii(instructionPointer * ip)
 {
 	char * restrict str;
 	floatint a;
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (FUNGE_UNLIKELY(!str)) {
 		ip_reverse(ip);
 		return;
 	}
 	a.f = strtof(str, NULL);
 	stack_push(ip->stack, a.i);
-	stack_free_string(str);
 }
 
 static void finger_FPSP_print(instructionPointer * ip)
 {
 	floatint a;
 	a.i = (int32_t)stack_pop(ip->stack);
-	printf("%f ", a.f);
+	(void)output_printf("%f ", a.f);
 }
 
 bool finger_FPSP_load(instructionPointer * ip)
@@ -22,8 +22,6 @@
 #include "FRTH.h"
 #include "../../stack.h"
 
-#include <string.h> /* memcpy */
-
 // This was partly based on how CCBI does it.
 
 /// D - Push depth of stack to tos
@@ -56,7 +54,7 @@ static void finger_FRTH_forth_roll(instructionPointer * ip)
 			ip_reverse(ip);
 			return;
 		}
-		memcpy(elems, ip->stack->entries, sizeof(funge_cell) * ip->stack->top);
+		stack_copy_range(ip->stack, 0, s, elems);
 		xu = elems[s - (u + 1)];
 
 		stack_discard(ip->stack, (size_t)(u + 1));
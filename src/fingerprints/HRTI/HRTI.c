@@ -20,6 +20,7 @@
  */
 
 #include "HRTI.h"
+#include "../../replay.h"
 #include "../../stack.h"
 
 #include <stdint.h>
@@ -121,7 +122,7 @@ static void finger_HRTI_erase_mark(instructionPointer * ip)
 /// G - Granularity
 static void finger_HRTI_granularity(instructionPointer * ip)
 {
-	stack_push(ip->stack, (funge_cell)resolution);
+	stack_push(ip->stack, (funge_cell)replay_value(replayTIMER, (int64_t)resolution));
 }
 
 /// M - Mark
@@ -143,7 +144,7 @@ static void finger_HRTI_timer(instructionPointer * ip)
 	} else {
 		timetype curTime;
 		TIMERFUNC(&curTime);
-		stack_push(ip->stack, get_difference(ip->fingerHRTItimestamp, &curTime));
+		stack_push(ip->stack, (funge_cell)replay_value(replayTIMER, (int64_t)get_difference(ip->fingerHRTItimestamp, &curTime)));
 	}
 }
 
@@ -152,7 +153,7 @@ static void finger_HRTI_second(instructionPointer * ip)
 {
 	timetype curTime;
 	TIMERFUNC(&curTime);
-	stack_push(ip->stack, (funge_cell)MSEC_P(&curTime));
+	stack_push(ip->stack, (funge_cell)replay_value(replayTIMER, (int64_t)MSEC_P(&curTime)));
 }
 
 FUNGE_ATTR_FAST static inline bool setup_HRTI(instructionPointer * ip)
@@ -24,6 +24,7 @@
 #include "NCRS.h"
 
 #if defined(HAVE_NCURSES)
+#include "../../output.h"
 #include "../../stack.h"
 
 #include <stdio.h>
@@ -47,7 +48,6 @@
 #  define bool _Bool
 #endif
 
-#define NCRS_VALIDATE_STATE_CLEANUP(_c) if (!ncrs_valid_state) { ip_reverse(ip); _c; return; }
 #define NCRS_VALIDATE_STATE() if (!ncrs_valid_state) { ip_reverse(ip); return; }
 
 /// Defines if we have ever ncrs_initialised.
@@ -119,6 +119,7 @@ static void finger_NCRS_get(instructionPointer * ip)
 {
 	funge_cell value;
 	NCRS_VALIDATE_STATE();
+	(void)output_flush();
 	if ((value = wgetch(ncrs_window)) == ERR)
 		ip_reverse(ip);
 	else
@@ -134,6 +135,7 @@ static void finger_NCRS_init(instructionPointer * ip)
 			// If TERM was used before, check to make sure we don't get a mem
 			// leak:
 			finger_TERM_fix_before_NCRS_init();
+			(void)output_flush();
 			ncrs_screen = newterm(NULL, stdout, stdin);
 			if (!ncrs_screen)
 				goto error;
@@ -227,6 +229,7 @@ static void finger_NCRS_put(instructionPointer * ip)
 static void finger_NCRS_refresh(instructionPointer * ip)
 {
 	NCRS_VALIDATE_STATE();
+	(void)output_flush();
 	if (refresh() == ERR)
 		ip_reverse(ip);
 }
@@ -234,11 +237,10 @@ static void finger_NCRS_refresh(instructionPointer * ip)
 /// S - Write string at cursor
 static void finger_NCRS_write(instructionPointer * ip)
 {
-	unsigned char* str = stack_pop_string(ip->stack, NULL);
-	NCRS_VALIDATE_STATE_CLEANUP(stack_free_string(str));
+	unsigned char* str = stack_pop_string_scratch(ip->stack, NULL, 0);
+	NCRS_VALIDATE_STATE();
 	if (waddstr(ncrs_window, (char*)str) == ERR)
 		ip_reverse(ip);
-	stack_free_string(str);
 }
 
 /// U - Unget character
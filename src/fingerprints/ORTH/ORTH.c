@@ -24,8 +24,9 @@
 #include "../../stack.h"
 #include "../../interpreter.h"
 #include "../../funge-space/funge-space.h"
+#include "../../output.h"
 
-#include <stdio.h> /* fputs */
+#include <string.h> /* strlen */
 
 
 static void finger_ORTH_bit_and(instructionPointer * ip)
@@ -74,14 +75,12 @@ static void finger_ORTH_put(instructionPointer * ip)
 // output string
 static void finger_ORTH_output_string(instructionPointer * ip)
 {
-	char * restrict str = (char*)stack_pop_string(ip->stack, NULL);
+	char * restrict str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (FUNGE_UNLIKELY(!str)) {
 		ip_reverse(ip);
 		return;
 	}
-	// puts add newline, we therefore do fputs on stdout
-	fputs(str, stdout);
-	stack_free_string(str);
+	(void)output_write(str, strlen(str));
 }
 
 // change dx
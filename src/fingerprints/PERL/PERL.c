@@ -26,9 +26,10 @@
 #include "../../stack.h"
 #include "../../diagnostic.h"
 #include "../../settings.h"
+#include "../../coprocess.h"
 #include "../../../lib/stringbuffer/stringbuffer.h"
 
-#include <unistd.h> /* close, dup2, execvp, fcntl, fork, pipe, read */
+#include <unistd.h> /* close, fcntl, read */
 #include <fcntl.h> /* fcntl */
 
 #include <sys/types.h> /* waitpid */
@@ -37,7 +38,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <stdio.h>
-#include <stdlib.h> /* _Exit, strtol */
+#include <stdlib.h> /* atexit, strtol */
 #include <string.h> /* strerror */
 
 // Used when reading back the result
@@ -49,17 +50,28 @@ static void finger_PERL_shelled(instructionPointer * ip)
 	stack_push(ip->stack, 1); // Not Perl, at least last I checked this was C.
 }
 
-// Yes... This is a mess...
+/// Sent to perl as its -e program. The evaluated code is passed as $ARGV[0].
+static char perl_spawn_driver[] =
+	"open(CFUNGE_REALERR, \">&STDERR\"); open(STDERR, \">&STDOUT\"); print CFUNGE_REALERR eval($ARGV[0])";
+
+/**
+ * Run perl once for this code. It is started with posix_spawn(), not fork(),
+ * since the interpreter may have other threads (-P, -A) and the child of a
+ * fork() could deadlock in malloc().
+ */
 FUNGE_ATTR_FAST
-static char * run_perl(const char * restrict perlcode, size_t * restrict retlength)
+static char * run_perl_spawned(char * restrict perlcode, size_t * restrict retlength)
 {
+	static char arg_perl[] = "perl";
+	static char arg_e[] = "-e";
 	pid_t pid;
+	int status;
 	int outfds[2]; // For pipe of stderr.
 
 	if (perlcode == NULL)
 		return NULL;
 
-	if (pipe(outfds) == -1)
+	if (!coprocess_pipe(outfds))
 		return NULL;
 
 	// Non-blocking to prevent locking up in read() in parent
@@ -70,123 +82,195 @@ static char * run_perl(const char * restrict perlcode, size_t * restrict retleng
 		return NULL;
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1: // Parent, error
-			DIAG_ERROR_FORMAT_LOC("Could not fork in run_perl: %s", strerror(errno));
-			// Clean up
+	{
+		char * const arguments[] = { arg_perl, arg_e, perl_spawn_driver, perlcode, NULL };
+		pid = coprocess_spawn_redirect("perl", arguments, 2, outfds[1]);
+	}
+	// Close unused end
+	close(outfds[1]);
+	if (pid == -1) {
+		// Message is followed by ": error"
+		DIAG_ERROR_FORMAT_LOC("Failed to run perl: %s", strerror(errno));
+		close(outfds[0]);
+		return NULL;
+	}
+
+	// Wait...
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
 			close(outfds[0]);
-			close(outfds[1]);
 			return NULL;
+		}
+	}
+	if (!WIFEXITED(status)) {
+		close(outfds[0]);
+		return NULL;
+	}
 
-		case 0: {
-			// Child
-
-			// Build argument list.
-			// Strdup to avoid the read only string warning.
-			// No need to free in child.
-			char * const arguments[] = {
-				strdup("perl"),
-				strdup("-e"),
-				strdup("open(CFUNGE_REALERR, \">&STDERR\"); open(STDERR, \">&STDOUT\"); print CFUNGE_REALERR eval($ARGV[0])"),
-				strdup(perlcode),
-				NULL
-			};
-			if (!arguments[0] || !arguments[1] || !arguments[2]
-			    || !arguments[3]) {
-				_Exit(2);
-			}
+	{
+		// Ok... get output :)
+		StringBuffer * sb;
+		char * buf;
 
-			// Do the FD stuff.
-			// Close unused end
+		sb = stringbuffer_new();
+		if (!sb) {
 			close(outfds[0]);
-			// Dup the FD
-			dup2(outfds[1], 2);
-			// Close unused copy
-			close(outfds[1]);
-
-			// Execute
-			if (execvp("perl", arguments) == -1) {
-				// If we got here...
-				// Message is followed by ": error"
-				DIAG_ERROR_FORMAT_LOC("Failed to run perl: %s", strerror(errno));
-			}
-			_Exit(2);
+			return NULL;
+		}
+		buf = malloc((STRINGALLOCCHUNK + 1) * sizeof(char));
+		if (!buf) {
+			stringbuffer_destroy(sb);
+			close(outfds[0]);
+			return NULL;
 		}
 
-		default: {
-			// Parent, success
-			int status;
-			// Close unused end
-			close(outfds[1]);
-			// Wait...
-			if (waitpid(pid, &status, 0) != -1) {
-				if (WIFEXITED(status)) {
-					// Ok... get output :)
-					StringBuffer * sb;
-					char * buf;
-
-					sb = stringbuffer_new();
-					if (!sb)
-						return NULL;
-					buf = malloc((STRINGALLOCCHUNK + 1) * sizeof(char));
-					if (!buf) {
-						stringbuffer_destroy(sb);
-						return NULL;
-					}
-
-					// Read the result
-					while (true) {
-						ssize_t n = read(outfds[0], buf, STRINGALLOCCHUNK);
-						int readErrno = errno;
-						if (n == -1) {
-							close(outfds[0]);
-							if (readErrno == EAGAIN) {
-								free(buf);
-								return stringbuffer_finish(sb, retlength);
-							} else {
-								DIAG_ERROR_FORMAT_LOC("Read failed in run_perl: %s", strerror(readErrno));
-								free(buf);
-								stringbuffer_destroy(sb);
-								return NULL;
-							}
-						// EOF.
-						} else if (n == 0) {
-							char * restrict result = stringbuffer_finish(sb, retlength);
-							close(outfds[0]);
-							free(buf);
-							if (!result || *retlength == 0) {
-								free(result);
-								return NULL;
-							} else {
-								return result;
-							}
-						} else if (n > 0) {
-							buf[n] = '\0';
-							stringbuffer_append_buffer(sb, buf, n);
-							if (n < STRINGALLOCCHUNK) {
-								close(outfds[0]);
-								free(buf);
-								return stringbuffer_finish(sb, retlength);
-							}
-						}
-					}
-
-				} else { /* WIFEXITED */
-					// Error
-					close(outfds[0]);
+		// Read the result
+		while (true) {
+			ssize_t n = read(outfds[0], buf, STRINGALLOCCHUNK);
+			int readErrno = errno;
+			if (n == -1) {
+				close(outfds[0]);
+				if (readErrno == EAGAIN) {
+					free(buf);
+					return stringbuffer_finish(sb, retlength);
+				} else {
+					DIAG_ERROR_FORMAT_LOC("Read failed in run_perl: %s", strerror(readErrno));
+					free(buf);
+					stringbuffer_destroy(sb);
 					return NULL;
 				}
-			} else { /* waitpid */
-				// Error
+			// EOF.
+			} else if (n == 0) {
+				char * restrict result = stringbuffer_finish(sb, retlength);
 				close(outfds[0]);
-				return NULL;
+				free(buf);
+				if (!result || *retlength == 0) {
+					free(result);
+					return NULL;
+				} else {
+					return result;
+				}
+			} else {
+				buf[n] = '\0';
+				stringbuffer_append_buffer(sb, buf, n);
+				if (n < STRINGALLOCCHUNK) {
+					close(outfds[0]);
+					free(buf);
+					return stringbuffer_finish(sb, retlength);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Persistent worker (-C option).
+ *
+ * Instead of starting a new perl for every call we start one that runs the
+ * driver below. Requests are written to its fd 3 as "<length>\n<code>" and it
+ * answers on fd 4 with "<length>\n<result>". Standard output and standard
+ * error are set up the same way as for the one-shot perl, so the only visible
+ * difference is that global variables live on between calls.
+ *
+ * If the worker is found dead it is restarted before the next request.
+ */
+static char perl_worker_driver[] =
+	"sub cfunge_eval { eval($_[0]) }"
+	"open(CFUNGE_IN, '<&=3') or exit 2;"
+	"open(CFUNGE_OUT, '>&=4') or exit 2;"
+	"binmode CFUNGE_IN; binmode CFUNGE_OUT;"
+	"open(STDERR, '>&STDOUT');"
+	"select((select(CFUNGE_OUT), $| = 1)[0]);"
+	"while (defined(my $cfunge_len = <CFUNGE_IN>)) {"
+	"  my $cfunge_code = '';"
+	"  last if read(CFUNGE_IN, $cfunge_code, $cfunge_len) != $cfunge_len;"
+	"  my $cfunge_res = join('', cfunge_eval($cfunge_code));"
+	"  utf8::encode($cfunge_res) if utf8::is_utf8($cfunge_res);"
+	"  select((select(STDOUT), $| = 1, $| = 0)[0]);"
+	"  local ($,, $\\);"
+	"  print CFUNGE_OUT length($cfunge_res), \"\\n\", $cfunge_res;"
+	"}";
+
+static coprocess perl_worker = COPROCESS_INIT;
+
+static void perl_worker_stop(void)
+{
+	coprocess_stop(&perl_worker);
+}
+
+/// Send the request, restarting the worker once if it turns out to be dead.
+/// A failed write means the worker never saw the code, so retrying is safe.
+FUNGE_ATTR_FAST
+static bool perl_worker_send(const char * restrict perlcode)
+{
+	static bool registered = false;
+	char header[32];
+	size_t codelen = strlen(perlcode);
+	int headerlen = snprintf(header, sizeof(header), "%zu\n", codelen);
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+		if (!coprocess_alive(&perl_worker)) {
+			static char arg_perl[] = "perl";
+			static char arg_e[] = "-e";
+			char * const arguments[] = { arg_perl, arg_e, perl_worker_driver, NULL };
+			if (!coprocess_start(&perl_worker, "perl", arguments, 3, 4, -1)) {
+				DIAG_ERROR_FORMAT_LOC("Failed to run perl: %s", strerror(errno));
+				return false;
 			}
-		} // default
-	} // switch
-	// This is never reached, just avoid ICC warnings.
-	// GCC can detect this is not reached.
-	return NULL;
+			if (!registered) {
+				atexit(&perl_worker_stop);
+				registered = true;
+			}
+		}
+		if (coprocess_send(&perl_worker, header, (size_t)headerlen)
+		    && coprocess_send(&perl_worker, perlcode, codelen))
+			return true;
+		coprocess_stop(&perl_worker);
+	}
+	return false;
+}
+
+FUNGE_ATTR_FAST
+static char * run_perl_worker(const char * restrict perlcode, size_t * restrict retlength)
+{
+	unsigned long length;
+	char * result;
+
+	if (perlcode == NULL || !perl_worker_send(perlcode))
+		return NULL;
+
+	// Anything unexpected means the worker died half way, most likely by the
+	// code calling exit. Next call will start a new one.
+	if (!coprocess_read_number(&perl_worker, &length)) {
+		coprocess_stop(&perl_worker);
+		return NULL;
+	}
+	result = malloc(length + 1);
+	if (!result) {
+		coprocess_stop(&perl_worker);
+		return NULL;
+	}
+	if (fread(result, 1, length, perl_worker.result) != length) {
+		free(result);
+		coprocess_stop(&perl_worker);
+		return NULL;
+	}
+	if (length == 0) {
+		free(result);
+		return NULL;
+	}
+	result[length] = '\0';
+	if (retlength)
+		*retlength = length;
+	return result;
+}
+
+FUNGE_ATTR_FAST
+static inline char * run_perl(char * restrict perlcode, size_t * restrict retlength)
+{
+	if (setting_persistent_coprocess)
+		return run_perl_worker(perlcode, retlength);
+	return run_perl_spawned(perlcode, retlength);
 }
 
 /// E - Evaluate 0gnirts
@@ -194,14 +278,13 @@ static void finger_PERL_eval(instructionPointer * ip)
 {
 	size_t length;
 	char * restrict result;
-	char * restrict perlcode = (char*)stack_pop_string(ip->stack, NULL);
+	char * restrict perlcode = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	result = run_perl(perlcode, &length);
 	if (result == NULL) {
 		ip_reverse(ip);
 	} else {
 		stack_push_string(ip->stack, (unsigned char*)result, length);
 	}
-	stack_free_string(perlcode);
 	free(result);
 }
 
@@ -209,7 +292,7 @@ static void finger_PERL_eval(instructionPointer * ip)
 static void finger_PERL_int_eval(instructionPointer * ip)
 {
 	char * restrict result;
-	char * restrict perlcode = (char*)stack_pop_string(ip->stack, NULL);
+	char * restrict perlcode = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	result = run_perl(perlcode, NULL);
 	if (result == NULL) {
 		ip_reverse(ip);
@@ -222,7 +305,6 @@ static void finger_PERL_int_eval(instructionPointer * ip)
 		else
 			stack_push(ip->stack, (funge_cell)i);
 	}
-	stack_free_string(perlcode);
 	free(result);
 }
 
@@ -147,7 +147,7 @@ static void finger_REXP_compile(instructionPointer * ip)
 		regfree(&compiled_regex);
 
 	flags = translate_flags_C(stack_pop(ip->stack));
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 
 	compret = regcomp(&compiled_regex, str, flags);
 
@@ -159,8 +159,6 @@ static void finger_REXP_compile(instructionPointer * ip)
 		compiled_valid = true;
 		compiled_nosub = (flags & REG_NOSUB);
 	}
-
-	stack_free_string(str);
 }
 
 /// E - Execute regular expression on string
@@ -176,7 +174,7 @@ static void finger_REXP_execute(instructionPointer * ip)
 	}
 
 	flags = translate_flags_E(stack_pop(ip->stack));
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 
 	execret = regexec(&compiled_regex, str, MATCHSIZE, matches, flags);
 	if (execret == 0) {
@@ -184,7 +182,6 @@ static void finger_REXP_execute(instructionPointer * ip)
 	} else {
 		ip_reverse(ip);
 	}
-	stack_free_string(str);
 }
 
 /// F - Free compiled regex buffer
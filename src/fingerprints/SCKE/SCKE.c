@@ -46,7 +46,7 @@ static void finger_SCKE_gethostbyname(instructionPointer * ip)
 	struct addrinfo *result = NULL;
 	int retval;
 
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 
 	memset(&hints, 0, sizeof(struct addrinfo));
 	hints.ai_family = AF_INET;
@@ -70,7 +70,6 @@ static void finger_SCKE_gethostbyname(instructionPointer * ip)
 error:
 	ip_reverse(ip);
 end:
-	stack_free_string(str);
 	if (result)
 		freeaddrinfo(result);
 }
@@ -23,8 +23,10 @@
 #define FUNGE_EXTENDS_SOCK
 
 #include "SOCK.h"
+#include "../../reactor.h"
 #include "../../stack.h"
 
+#include <errno.h>
 #include <unistd.h> /* close, fcntl */
 #include <fcntl.h>  /* fcntl */
 
@@ -82,6 +84,7 @@ static inline funge_cell allocate_handle(void)
 	sockets[h] = malloc(sizeof(FungeSocketHandle));
 	if (!sockets[h])
 		return -1;
+	sockets[h]->connecting = false;
 	return h;
 }
 
@@ -115,15 +118,38 @@ FungeSocketHandle* finger_SOCK_LookupHandle(funge_cell h)
 }
 
 
-static inline int popFam(instructionPointer * ip)
+/// Make a new socket close-on-exec and non-blocking.
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline bool setup_fd(int fd)
 {
-	switch (stack_pop(ip->stack)) {
+	int flags;
+
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0)
+		return false;
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+		return false;
+	return true;
+}
+
+/// Check if a failed call on a non-blocking socket should be retried later.
+#define WOULD_BLOCK(m_errno) \
+	((m_errno) == EAGAIN || (m_errno) == EWOULDBLOCK || (m_errno) == EINTR)
+
+static inline int cellToFam(funge_cell fam)
+{
+	switch (fam) {
 		case 1:  return AF_UNIX;
 		case 2:  return AF_INET;
 		default: return AF_UNSPEC;
 	}
 }
 
+static inline int popFam(instructionPointer * ip)
+{
+	return cellToFam(stack_pop(ip->stack));
+}
+
 
 /// A - Accept a connection
 static void finger_SOCK_accept(instructionPointer * ip)
@@ -143,11 +169,19 @@ static void finger_SOCK_accept(instructionPointer * ip)
 		addr.in.sin_port = 0;
 		addr.in.sin_family = AF_INET;
 
+retry:
 		as = accept(sockets[s]->fd, &addr.gen, &addrlen);
-		if (as == -1)
-			goto error;
+		if (as == -1) {
+			if (!WOULD_BLOCK(errno))
+				goto error;
+			if (reactor_wait(ip, sockets[s]->fd, POLLIN)) {
+				stack_push(ip->stack, s);
+				return;
+			}
+			goto retry;
+		}
 
-		if (fcntl(as, F_SETFD, FD_CLOEXEC, 1) != 0)
+		if (!setup_fd(as))
 		{
 			close(as);
 			goto error;
@@ -161,6 +195,7 @@ static void finger_SOCK_accept(instructionPointer * ip)
 		}
 		sockets[i]->fd = as;
 		sockets[i]->family = sockets[s]->family;
+		sockets[i]->type = SOCK_STREAM;
 
 		stack_push(ip->stack, addr.in.sin_port);
 		stack_push(ip->stack, (funge_cell)addr.in.sin_addr.s_addr);
@@ -206,10 +241,11 @@ error:
 /// C - Open a connection
 static void finger_SOCK_open(instructionPointer * ip)
 {
-	uint32_t  address = (uint32_t)stack_pop(ip->stack);
-	uint16_t  port    = (uint16_t)stack_pop(ip->stack);
-	int       fam     = popFam(ip);
+	funge_cell address = stack_pop(ip->stack);
+	funge_cell port    = stack_pop(ip->stack);
+	funge_cell famcell = stack_pop(ip->stack);
 	funge_cell s       = stack_pop(ip->stack);
+	int        fam     = cellToFam(famcell);
 	FungeSockAddr addr;
 
 	if (!valid_handle(s))
@@ -220,13 +256,30 @@ static void finger_SOCK_open(instructionPointer * ip)
 			int retval;
 
 			addr.in.sin_family = AF_INET;
-			addr.in.sin_addr.s_addr = address;
-			addr.in.sin_port = htons(port);
+			addr.in.sin_addr.s_addr = (uint32_t)address;
+			addr.in.sin_port = htons((uint16_t)port);
 
+retry:
 			retval = connect(sockets[s]->fd, &addr.gen, sizeof(addr.in));
-			if (retval == -1)
-				goto error;
-
+			if (retval == -1) {
+				if (errno == EISCONN && sockets[s]->connecting) {
+					// Connected while we were parked.
+				} else if (errno == EINPROGRESS || errno == EALREADY || errno == EINTR) {
+					sockets[s]->connecting = true;
+					if (reactor_wait(ip, sockets[s]->fd, POLLOUT)) {
+						stack_push(ip->stack, s);
+						stack_push(ip->stack, famcell);
+						stack_push(ip->stack, port);
+						stack_push(ip->stack, address);
+						return;
+					}
+					goto retry;
+				} else {
+					sockets[s]->connecting = false;
+					goto error;
+				}
+			}
+			sockets[s]->connecting = false;
 			break;
 		}
 		default: goto error;
@@ -242,13 +295,12 @@ static void finger_SOCK_fromascii(instructionPointer * ip)
 	char * restrict str;
 	struct in_addr addr;
 
-	str = (char*)stack_pop_string(ip->stack, NULL);
+	str = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (inet_pton(AF_INET, str, &addr) != 1) {
 		ip_reverse(ip);
 	} else {
 		stack_push(ip->stack, (funge_cell)addr.s_addr);
 	}
-	stack_free_string(str);
 
 }
 
@@ -324,8 +376,11 @@ error:
 /// R - Receive from a socket
 static void finger_SOCK_receive(instructionPointer * ip)
 {
-	unsigned char *buffer = NULL;
+	unsigned char tile[FUNGESPACE_TILE_SIZE];
+	unsigned char *buffer = tile;
+	size_t want;
 	ssize_t got;
+	funge_cell total = 0;
 	funge_cell s   = stack_pop(ip->stack);
 	funge_cell len = stack_pop(ip->stack);
 
@@ -337,28 +392,52 @@ static void finger_SOCK_receive(instructionPointer * ip)
 	if (!valid_handle(s))
 		goto error;
 
-	v.x += ip->storageOffset.x;
-	v.y += ip->storageOffset.y;
-
-	buffer = malloc((size_t)len * sizeof(unsigned char));
-	if (FUNGE_UNLIKELY(!buffer))
-		goto error;
-
-	got = recv(sockets[s]->fd, buffer, (size_t)len, 0);
+	want = (size_t)len;
+	if (want > sizeof(tile)) {
+		// A datagram has to be received in one go.
+		if (sockets[s]->type == SOCK_STREAM) {
+			want = sizeof(tile);
+		} else {
+			buffer = malloc(want);
+			if (FUNGE_UNLIKELY(!buffer))
+				goto error;
+		}
+	}
 
-	stack_push(ip->stack, (funge_cell)got);
+	while ((got = recv(sockets[s]->fd, buffer, want, 0)) == -1 && WOULD_BLOCK(errno)) {
+		if (reactor_wait(ip, sockets[s]->fd, POLLIN)) {
+			stack_push_vector(ip->stack, &v);
+			stack_push(ip->stack, len);
+			stack_push(ip->stack, s);
+			goto end;
+		}
+	}
 
-	if (got == -1)
+	if (got == -1) {
+		stack_push(ip->stack, -1);
 		goto error;
+	}
 
-	for (ssize_t i = 0; i < got; ++i)
-		fungespace_set(buffer[i], vector_create_ref(v.x + i, v.y));
+	v.x += ip->storageOffset.x;
+	v.y += ip->storageOffset.y;
+
+	// Take the rest of what is already there, a tile at a time.
+	while (got > 0) {
+		fungespace_set_bytes(buffer, (size_t)got, &v);
+		v.x += (funge_cell)got;
+		total += (funge_cell)got;
+		if ((size_t)got < want || total == len)
+			break;
+		want = (size_t)(len - total) < sizeof(tile) ? (size_t)(len - total) : sizeof(tile);
+		got = recv(sockets[s]->fd, buffer, want, 0);
+	}
+	stack_push(ip->stack, total);
 
 	goto end;
 error:
 	ip_reverse(ip);
 end:
-	if (buffer)
+	if (buffer != tile)
 		free(buffer);
 }
 
@@ -391,13 +470,14 @@ static void finger_SOCK_create(instructionPointer * ip)
 		if (sockets[h]->fd == -1)
 			goto error;
 
-		if (fcntl(sockets[h]->fd, F_SETFD, FD_CLOEXEC, 1) != 0)
+		if (!setup_fd(sockets[h]->fd))
 		{
 			close(sockets[h]->fd);
 			goto error;
 		}
 
 		sockets[h]->family = fam;
+		sockets[h]->type = type;
 
 		stack_push(ip->stack, h);
 	}
@@ -409,8 +489,11 @@ error:
 /// W - Write to a socket
 static void finger_SOCK_write(instructionPointer * ip)
 {
-	unsigned char *buffer = NULL;
+	unsigned char tile[FUNGESPACE_TILE_SIZE];
+	unsigned char *buffer = tile;
+	size_t want;
 	ssize_t sent;
+	funge_cell total = 0;
 	funge_cell s   = stack_pop(ip->stack);
 	funge_cell len = stack_pop(ip->stack);
 
@@ -425,25 +508,53 @@ static void finger_SOCK_write(instructionPointer * ip)
 	v.x += ip->storageOffset.x;
 	v.y += ip->storageOffset.y;
 
-	buffer = malloc((size_t)len * sizeof(unsigned char));
-	if (FUNGE_UNLIKELY(!buffer))
-		goto error;
-
-	for (size_t i = 0; i < (size_t)len; ++i)
-		buffer[i] = (unsigned char)fungespace_get(vector_create_ref(v.x + (funge_cell)i, v.y));
+	want = (size_t)len;
+	if (want > sizeof(tile)) {
+		// A datagram has to be sent in one go.
+		if (sockets[s]->type == SOCK_STREAM) {
+			want = sizeof(tile);
+		} else {
+			buffer = malloc(want);
+			if (FUNGE_UNLIKELY(!buffer))
+				goto error;
+		}
+	}
 
-	sent = send(sockets[s]->fd, buffer, (size_t)len, 0);
+	fungespace_get_bytes(buffer, want, &v);
 
-	stack_push(ip->stack, (funge_cell)sent);
+	while ((sent = send(sockets[s]->fd, buffer, want, 0)) == -1 && WOULD_BLOCK(errno)) {
+		if (reactor_wait(ip, sockets[s]->fd, POLLOUT)) {
+			v.x -= ip->storageOffset.x;
+			v.y -= ip->storageOffset.y;
+			stack_push_vector(ip->stack, &v);
+			stack_push(ip->stack, len);
+			stack_push(ip->stack, s);
+			goto end;
+		}
+	}
 
-	if (sent == -1)
+	if (sent == -1) {
+		stack_push(ip->stack, -1);
 		goto error;
+	}
+
+	// Send the rest a tile at a time, as long as the socket takes it.
+	while (sent > 0) {
+		v.x += (funge_cell)sent;
+		total += (funge_cell)sent;
+		if ((size_t)sent < want || total == len)
+			break;
+		want = (size_t)(len - total) < sizeof(tile) ? (size_t)(len - total) : sizeof(tile);
+		fungespace_get_bytes(buffer, want, &v);
+		sent = send(sockets[s]->fd, buffer, want, 0);
+	}
+	stack_push(ip->stack, total);
 
 	goto end;
 error:
 	ip_reverse(ip);
 end:
-	if (buffer)
+	if (buffer != tile)
 		free(buffer);
 }
 
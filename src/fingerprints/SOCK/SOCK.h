@@ -31,7 +31,9 @@ bool finger_SOCK_load(instructionPointer * ip);
 #ifdef FUNGE_EXTENDS_SOCK
 typedef struct FungeSocketHandle {
 	int family;
-	int fd;
+	int type;       ///< SOCK_STREAM or SOCK_DGRAM.
+	int fd;         ///< Non-blocking, see reactor.h.
+	bool connecting; ///< A non-blocking connect() is in progress.
 } FungeSocketHandle;
 
 FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
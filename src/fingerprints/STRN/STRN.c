@@ -22,6 +22,7 @@
 #include "STRN.h"
 #include "../../stack.h"
 #include "../../input.h"
+#include "../../output.h"
 
 #include <stdlib.h> /* atoi */
 #include <string.h>
@@ -34,35 +35,17 @@
 static void finger_STRN_append(instructionPointer * ip)
 {
 	funge_cell * top;
-	funge_cell * restrict bottom;
-	funge_cell * c = NULL;
 	size_t top_len;
-	size_t bottom_len;
-
-	top = stack_pop_string_multibyte(ip->stack, &top_len);
-	bottom = stack_pop_string_multibyte(ip->stack, &bottom_len);
-	if (FUNGE_UNLIKELY(!top || !bottom)) {
-		goto error;
-	}
 
-	c = realloc(top, (top_len + bottom_len + 1) * sizeof(funge_cell));
-	if (FUNGE_UNLIKELY(!c)) {
-		goto error;
+	// The bottom string is already where the result should end up, so just
+	// put back the top string without its terminator.
+	top = stack_pop_string_multibyte_scratch(ip->stack, &top_len, 0);
+	if (FUNGE_UNLIKELY(!top)) {
+		ip_reverse(ip);
+		return;
 	}
-	memcpy(c + top_len, bottom, bottom_len * sizeof(funge_cell));
-	c[top_len + bottom_len] = '\0';
-
-	stack_push_string_multibyte(ip->stack, c, bottom_len + top_len);
-
-	stack_free_string(bottom);
-	free(c);
-	return;
-error:
-	ip_reverse(ip);
-	if (top)
-		stack_free_string(top);
-	if (bottom)
-		stack_free_string(bottom);
+	if (top_len > 0)
+		stack_push_string_multibyte(ip->stack, top, top_len - 1);
 }
 
 /// C - Compare strings
@@ -73,13 +56,10 @@ static void finger_STRN_compare(instructionPointer * ip)
 	size_t alen = 0, blen = 0, minlen;
 	funge_cell comparsion = 0;
 
-	a = stack_pop_string_multibyte(ip->stack, &alen);
-	b = stack_pop_string_multibyte(ip->stack, &blen);
+	a = stack_pop_string_multibyte_scratch(ip->stack, &alen, 0);
+	b = stack_pop_string_multibyte_scratch(ip->stack, &blen, 1);
 
 	if (FUNGE_UNLIKELY(!a || !b)) {
-		// Ok even if NULL.
-		stack_free_string(a);
-		stack_free_string(b);
 		ip_reverse(ip);
 		return;
 	}
@@ -95,21 +75,18 @@ static void finger_STRN_compare(instructionPointer * ip)
 	}
 
 	stack_push(ip->stack, comparsion);
-	stack_free_string(a);
-	stack_free_string(b);
 }
 
 /// D - Display a string
 static void finger_STRN_display(instructionPointer * ip)
 {
 	unsigned char * restrict s;
-	s = stack_pop_string(ip->stack, NULL);
+	s = stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (FUNGE_UNLIKELY(!s)) {
 		ip_reverse(ip);
 		return;
 	}
-	fputs((char*)s, stdout);
-	stack_free_string(s);
+	(void)output_write(s, strlen((char*)s));
 }
 
 /// F - Search for bottom string in upper string
@@ -118,12 +95,9 @@ static void finger_STRN_search(instructionPointer * ip)
 	funge_cell * top;
 	funge_cell * restrict bottom;
 	funge_cell * c;
-	top = stack_pop_string_multibyte(ip->stack, NULL);
-	bottom = stack_pop_string_multibyte(ip->stack, NULL);
+	top = stack_pop_string_multibyte_scratch(ip->stack, NULL, 0);
+	bottom = stack_pop_string_multibyte_scratch(ip->stack, NULL, 1);
 	if (FUNGE_UNLIKELY(!top || !bottom)) {
-		// Ok even if NULL.
-		stack_free_string(top);
-		stack_free_string(bottom);
 		ip_reverse(ip);
 		return;
 	}
@@ -133,8 +107,6 @@ static void finger_STRN_search(instructionPointer * ip)
 	} else {
 		stack_push(ip->stack, '\0');
 	}
-	stack_free_string(top);
-	stack_free_string(bottom);
 }
 
 /// G - Get string from specified position
@@ -208,15 +180,13 @@ static void finger_STRN_left(instructionPointer * ip)
 	size_t len;
 	funge_cell *s;
 	n = stack_pop(ip->stack);
-	s = stack_pop_string_multibyte(ip->stack, &len);
-	if (n < 0) {
-		stack_free_string(s);
+	s = stack_pop_string_multibyte_scratch(ip->stack, &len, 0);
+	if (n < 0 || FUNGE_UNLIKELY(!s)) {
 		ip_reverse(ip);
 		return;
 	}
 	if (n == 0) {
 		stack_push(ip->stack, '\0');
-		stack_free_string(s);
 		return;
 	}
 	if (len < (size_t)n) {
@@ -224,7 +194,6 @@ static void finger_STRN_left(instructionPointer * ip)
 	}
 	stack_push(ip->stack, '\0');
 	stack_push_string_multibyte(ip->stack, s, (size_t)(n - 1));
-	stack_free_string(s);
 }
 
 /// M - n characters starting at position p
@@ -235,9 +204,8 @@ static void finger_STRN_slice(instructionPointer * ip)
 	size_t slen;
 	n = stack_pop(ip->stack);
 	p = stack_pop(ip->stack);
-	s = stack_pop_string_multibyte(ip->stack, &slen);
-	if (p < 0 || n < 0 || slen < (size_t)p) {
-		stack_free_string(s);
+	s = stack_pop_string_multibyte_scratch(ip->stack, &slen, 0);
+	if (p < 0 || n < 0 || slen < (size_t)p || FUNGE_UNLIKELY(!s)) {
 		ip_reverse(ip);
 		return;
 	}
@@ -246,7 +214,6 @@ static void finger_STRN_slice(instructionPointer * ip)
 	}
 	s[p + n] = '\0';
 	stack_push_string_multibyte(ip->stack, s + p, slen - p);
-	stack_free_string(s);
 }
 
 /// N - Get length of string
@@ -280,9 +247,8 @@ static void finger_STRN_right(instructionPointer * ip)
 	size_t len;
 	funge_cell *s;
 	n = stack_pop(ip->stack);
-	s = stack_pop_string_multibyte(ip->stack, &len);
-	if (n < 0) {
-		stack_free_string(s);
+	s = stack_pop_string_multibyte_scratch(ip->stack, &len, 0);
+	if (n < 0 || FUNGE_UNLIKELY(!s)) {
 		ip_reverse(ip);
 		return;
 	}
@@ -290,7 +256,6 @@ static void finger_STRN_right(instructionPointer * ip)
 		n = len;
 	}
 	stack_push_string_multibyte(ip->stack, s + (len - (size_t)n), (size_t)n);
-	stack_free_string(s);
 }
 
 /// S - String representation of a number
@@ -315,13 +280,12 @@ static void finger_STRN_itoa(instructionPointer * ip)
 static void finger_STRN_atoi(instructionPointer * ip)
 {
 	unsigned char *s;
-	s = stack_pop_string(ip->stack, NULL);
+	s = stack_pop_string_scratch(ip->stack, NULL, 0);
 	if (FUNGE_UNLIKELY(!s)) {
 		ip_reverse(ip);
 		return;
 	}
 	stack_push(ip->stack, FUNGE_ATOI((char*)s));
-	stack_free_string(s);
 }
 
 bool finger_STRN_load(instructionPointer * ip)
@@ -20,6 +20,7 @@
  */
 
 #include "SUBR.h"
+#include "../../sampler.h"
 #include "../../stack.h"
 #include "../../vector.h"
 
@@ -65,6 +66,8 @@ static void finger_SUBR_call(instructionPointer * ip)
 		stack_push(ip->stack, stack_pop(tmpstack));
 	stack_free(tmpstack);
 
+	if (FUNGE_UNLIKELY(sampler_enabled))
+		sampler_subr_call(ip, &pos);
 	ip_set_position(ip, &pos);
 	ip->delta = SUBRnewDelta;
 	ip->needMove = false;
@@ -116,6 +119,8 @@ static void finger_SUBR_return(instructionPointer * ip)
 	pos = stack_pop_vector(ip->stack);
 	ip_set_position(ip, &pos);
 	ip->delta = vec;
+	if (FUNGE_UNLIKELY(sampler_enabled))
+		sampler_subr_return(ip);
 
 	while (n--)
 		stack_push(ip->stack, stack_pop(tmpstack));
@@ -20,6 +20,7 @@
  */
 
 #include "TIME.h"
+#include "../../replay.h"
 #include "../../stack.h"
 
 
@@ -30,7 +31,7 @@ static bool TIMEuseUTC = false;
 #define GetTheTime \
 	time_t now; \
 	struct tm curTime; \
-	now = time(NULL); \
+	now = (time_t)replay_value(replayTIME, (int64_t)time(NULL)); \
 	if (TIMEuseUTC) \
 		gmtime_r(&now, &curTime); \
 	else \
@@ -97,9 +97,8 @@ static void finger_TOYS_toilet_seat(instructionPointer * ip)
 static void finger_TOYS_pitchfork_head(instructionPointer * ip)
 {
 	funge_cell sum = 0;
-	for (size_t i = 0; i < ip->stack->top; i++)
-		sum += ip->stack->entries[i];
-	stack_clear(ip->stack);
+	while (ip->stack->top > 0)
+		sum += stack_pop(ip->stack);
 	stack_push(ip->stack, sum);
 }
 
@@ -261,9 +260,8 @@ static void finger_TOYS_boulder(instructionPointer * ip)
 static void finger_TOYS_mailbox(instructionPointer * ip)
 {
 	funge_cell product = 1;
-	for (size_t i = 0; i < ip->stack->top; i++)
-		product *= ip->stack->entries[i];
-	stack_clear(ip->stack);
+	while (ip->stack->top > 0)
+		product *= stack_pop(ip->stack);
 	stack_push(ip->stack, product);
 }
 
@@ -322,7 +320,7 @@ static void finger_TOYS_barstool(instructionPointer * ip)
 /// U - tumbler (Like ? but replaces instruction with said random choice)
 static void finger_TOYS_tumbler(instructionPointer * ip)
 {
-	funge_unsigned_cell rnd = prng_generate_unsigned(4);
+	funge_unsigned_cell rnd = prng_generate_unsigned(&ip->prng, 4);
 	switch (rnd) {
 		case 0: fungespace_set('^', &ip->position); ip_go_north(ip); break;
 		case 1: fungespace_set('>', &ip->position); ip_go_east(ip); break;
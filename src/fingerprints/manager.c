@@ -22,6 +22,7 @@
 #include "../global.h"
 #include "manager.h"
 #include "../ip.h"
+#include "../probes.h"
 #include "../settings.h"
 #include "../diagnostic.h"
 
@@ -166,14 +167,98 @@ static inline ssize_t find_fingerprint(const funge_cell fingerprint)
 	return FPRINT_NOTFOUND;
 }
 
+/**************************
+ * Binding tracking (-p)  *
+ **************************/
+
+bool manager_track_bindings = false;
+
+/// Which fingerprint an opcode implementation belongs to.
+typedef struct s_managerBinding {
+	fingerprintOpcode func;
+	funge_cell        fprint;
+} managerBinding;
+
+static managerBinding * bindings = NULL;
+static size_t           bindings_count = 0;
+static size_t           bindings_size = 0;
+
+/**
+ * Remember which fingerprint the functions just loaded for index came from.
+ * There are only a few hundred implementations, so a plain array will do.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void record_bindings(const instructionPointer * restrict ip, size_t index)
+{
+	const char * opcodes = ImplementedFingerprints[index].opcodes;
+
+	for (size_t i = 0; opcodes[i] != '\0'; i++) {
+		const fungeOpcodeStack * stack = &ip->fingerOpcodes[opcodes[i] - 'A'];
+		fingerprintOpcode func;
+		size_t j;
+
+		if (stack->top == 0)
+			continue;
+		func = stack->entries[stack->top - 1];
+		for (j = 0; j < bindings_count; j++)
+			if (bindings[j].func == func)
+				break;
+		if (j < bindings_count)
+			continue;
+		if (bindings_count == bindings_size) {
+			size_t newsize = bindings_size ? bindings_size * 2 : 64;
+			managerBinding * tmp = realloc(bindings, newsize * sizeof(managerBinding));
+			// Just means the sample won't say what fingerprint it was.
+			if (FUNGE_UNLIKELY(!tmp))
+				return;
+			bindings = tmp;
+			bindings_size = newsize;
+		}
+		bindings[bindings_count].func = func;
+		bindings[bindings_count].fprint = ImplementedFingerprints[index].fprint;
+		bindings_count++;
+	}
+}
+
+FUNGE_ATTR_FAST
+bool manager_binding_name(const instructionPointer * restrict ip, funge_cell opcode, char name[5])
+{
+	const fungeOpcodeStack * stack;
+	fingerprintOpcode func;
+
+	if (opcode < 'A' || opcode > 'Z')
+		return false;
+	stack = &ip->fingerOpcodes[opcode - 'A'];
+	if (stack->top == 0)
+		return false;
+	func = stack->entries[stack->top - 1];
+	for (size_t i = 0; i < bindings_count; i++) {
+		if (bindings[i].func == func) {
+			size_t len = 0;
+			for (int shift = 24; shift >= 0; shift -= 8) {
+				int c = (int)((bindings[i].fprint >> shift) & 0xff);
+				if (c != 0)
+					name[len++] = (c > ' ' && c < 127 && c != ';') ? (char)c : '?';
+			}
+			name[len] = '\0';
+			return true;
+		}
+	}
+	return false;
+}
+
 FUNGE_ATTR_FAST bool manager_load(instructionPointer * restrict ip, funge_cell fingerprint)
 {
 	ssize_t index = find_fingerprint(fingerprint);
 	if (index == FPRINT_NOTFOUND) {
+		FUNGE_PROBE3(fprint_load, ip->ID, fingerprint, 0);
 		return false;
 	} else {
 		bool gotLoaded = ImplementedFingerprints[index].loader(ip);
+		FUNGE_PROBE3(fprint_load, ip->ID, fingerprint, gotLoaded ? 1 : 0);
 		if (FUNGE_LIKELY(gotLoaded)) {
+			if (FUNGE_UNLIKELY(manager_track_bindings))
+				record_bindings(ip, (size_t)index);
 			stack_push(ip->stack, fingerprint);
 			stack_push(ip->stack, 1);
 			return true;
@@ -188,6 +273,7 @@ FUNGE_ATTR_FAST bool manager_unload(instructionPointer * restrict ip, funge_cell
 	ssize_t index = find_fingerprint(fingerprint);
 	size_t max_len;
 
+	FUNGE_PROBE3(fprint_unload, ip->ID, fingerprint, index == FPRINT_NOTFOUND ? 0 : 1);
 	if (index == FPRINT_NOTFOUND)
 		return false;
 	max_len = strlen(ImplementedFingerprints[index].opcodes);
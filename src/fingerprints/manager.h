@@ -125,6 +125,21 @@ bool manager_load(struct s_instructionPointer * restrict ip, funge_cell fingerpr
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
 bool manager_unload(struct s_instructionPointer * restrict ip, funge_cell fingerprint);
 
+/// If true manager_load() records what fingerprint each opcode function
+/// belongs to, for manager_binding_name(). Set by the profiler.
+extern bool manager_track_bindings;
+
+/**
+ * Find the name of the fingerprint opcode is currently bound to in ip.
+ * Only works if manager_track_bindings was set before the fingerprint was loaded.
+ * @param ip IP to look in.
+ * @param opcode Instruction, anything outside A-Z returns false.
+ * @param name Gets the name, NUL terminated.
+ * @return True if found, otherwise false.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+bool manager_binding_name(const struct s_instructionPointer * restrict ip, funge_cell opcode, char name[5]);
+
 /**
  * Print out list of supported fingerprints
  */
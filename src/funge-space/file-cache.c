@@ -0,0 +1,402 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "../global.h"
+#include "file-cache.h"
+#include "../diagnostic.h"
+#include "../settings.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>    /* close, read */
+
+#include <sys/types.h>
+#include <sys/stat.h>  /* fstat, stat */
+#include <fcntl.h>     /* open */
+#include <sys/mman.h>  /* mmap, munmap, posix_madvise */
+
+/*
+ * How it works:
+ * * Entries are kept in a doubly linked list in least recently used order,
+ *   the most recently used one first. Programs tend to use only a few files,
+ *   so a linear search is fine.
+ * * A hit costs a stat() of the file, nothing more.
+ * * A file modified during the last second is never cached, since mtime only
+ *   has a resolution of one second and it could change again without the
+ *   mtime or size changing (same idea as the "racy git" check).
+ */
+
+typedef struct fileCacheEntry {
+	struct fileCacheEntry * prev;
+	struct fileCacheEntry * next;
+	dev_t                   dev;
+	ino_t                   ino;
+	off_t                   size;
+	time_t                  mtime;
+	bool                    binary;
+	size_t                  bytes; ///< Memory used by this entry.
+	fungeImage              image;
+	char                    filename[]; // C99 flexible array member
+} fileCacheEntry;
+
+/// Most recently used entry.
+static fileCacheEntry *cache_head = NULL;
+/// Least recently used entry.
+static fileCacheEntry *cache_tail = NULL;
+/// Image that was too large to cache, freed on next call.
+static fileCacheEntry *cache_uncached = NULL;
+static fileCacheStats cache_stats = { 0, 0, 0, 0, 0 };
+
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void entry_unlink(fileCacheEntry * restrict entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache_head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache_tail = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void entry_push_front(fileCacheEntry * restrict entry)
+{
+	entry->prev = NULL;
+	entry->next = cache_head;
+	if (cache_head)
+		cache_head->prev = entry;
+	else
+		cache_tail = entry;
+	cache_head = entry;
+}
+
+FUNGE_ATTR_FAST
+static void entry_free(fileCacheEntry * entry)
+{
+	if (!entry)
+		return;
+	free(entry->image.runs);
+	free(entry->image.cells);
+	free(entry);
+}
+
+/// Remove an entry from the cache and free it.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void entry_remove(fileCacheEntry * entry)
+{
+	entry_unlink(entry);
+	cache_stats.entries--;
+	cache_stats.bytes -= entry->bytes;
+	entry_free(entry);
+}
+
+/// Add a cell to the image, extending the last run if possible.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void image_add(fungeImage * restrict image, size_t * restrict ncells,
+                             size_t * restrict maxruns, unsigned char value,
+                             funge_cell x, funge_cell y)
+{
+	fungeImageRun *last = image->nruns ? &image->runs[image->nruns - 1] : NULL;
+
+	image->cells[*ncells] = value;
+	if (last && last->pos.y == y && last->pos.x + (funge_cell)last->len == x) {
+		last->len++;
+	} else {
+		if (FUNGE_UNLIKELY(image->nruns == *maxruns)) {
+			fungeImageRun *newruns;
+			*maxruns *= 2;
+			newruns = realloc(image->runs, *maxruns * sizeof(fungeImageRun));
+			if (FUNGE_UNLIKELY(!newruns)) {
+				DIAG_OOM("Couldn't grow run list while parsing file");
+			}
+			image->runs = newruns;
+		}
+		image->runs[image->nruns].pos.x = x;
+		image->runs[image->nruns].pos.y = y;
+		image->runs[image->nruns].first = *ncells;
+		image->runs[image->nruns].len = 1;
+		image->nruns++;
+	}
+	(*ncells)++;
+}
+
+/// Macro for handling newlines.
+#define FILECACHE_NEWLINE \
+	if (pos.x > image->size.x) \
+		image->size.x = pos.x; \
+	pos.x = 0; \
+	pos.y++;
+
+/**
+ * Parse a file into an image.
+ * @param length Size of the file, must not be 0 (addr is NULL then).
+ * @return Number of cells in the image.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static size_t image_parse(fungeImage * restrict image,
+                          const unsigned char * restrict addr, size_t length,
+                          bool binary)
+{
+	size_t ncells = 0;
+	size_t maxruns = 64;
+	funge_vector pos = {0, 0};
+
+	image->size.x = 0;
+	image->size.y = 0;
+	image->nruns = 0;
+	image->runs = NULL;
+	image->cells = NULL;
+
+	// There can't be more cells than bytes in the file.
+	image->cells = malloc(length);
+	image->runs = malloc(maxruns * sizeof(fungeImageRun));
+	if (FUNGE_UNLIKELY(!image->cells || !image->runs)) {
+		DIAG_OOM("Couldn't allocate memory for parsing file");
+	}
+
+	if (binary) {
+		for (size_t i = 0; i < length; i++) {
+			if (addr[i] != ' ')
+				image_add(image, &ncells, &maxruns, addr[i], pos.x, 0);
+			pos.x++;
+		}
+	} else {
+		bool lastwascr = false;
+		for (size_t i = 0; i < length; i++) {
+			switch (addr[i]) {
+				// Ignore form feed. Treat it as newline is treated in Unefunge.
+				case '\f':
+					break;
+				case '\r':
+					if (lastwascr) {
+						// Blergh two \r after each other.
+						FILECACHE_NEWLINE
+					}
+					lastwascr = true;
+					break;
+				case '\n':
+					FILECACHE_NEWLINE
+					lastwascr = false;
+					break;
+				default:
+					if (lastwascr) {
+						lastwascr = false;
+						FILECACHE_NEWLINE
+					}
+					if (addr[i] != ' ')
+						image_add(image, &ncells, &maxruns, addr[i], pos.x, pos.y);
+					pos.x++;
+					break;
+			}
+		}
+		if (lastwascr) pos.y++;
+	}
+	if (pos.x > image->size.x) image->size.x = pos.x;
+	if (pos.y > image->size.y) image->size.y = pos.y;
+
+	// Give back what we didn't use, it may stay around for a long time.
+	if (ncells == 0) {
+		free(image->cells);
+		free(image->runs);
+		image->cells = NULL;
+		image->runs = NULL;
+	} else {
+		unsigned char *cells = realloc(image->cells, ncells);
+		fungeImageRun *runs = realloc(image->runs, image->nruns * sizeof(fungeImageRun));
+		if (cells)
+			image->cells = cells;
+		if (runs)
+			image->runs = runs;
+	}
+	return ncells;
+}
+
+/**
+ * Read and parse a file into a new entry.
+ * @return The entry (not linked into the cache), or NULL with errno set.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static fileCacheEntry * entry_load(const char * restrict filename, bool binary)
+{
+	struct stat sb;
+	unsigned char *addr = NULL;
+	size_t length, namelen, ncells;
+	fileCacheEntry *entry;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (FUNGE_UNLIKELY(fd == -1))
+		return NULL;
+	if (FUNGE_UNLIKELY(fstat(fd, &sb) == -1)) {
+		int saved = errno;
+		diag_error_format("fstat() on file \"%s\" failed: %s", filename, strerror(errno));
+		close(fd);
+		errno = saved;
+		return NULL;
+	}
+	length = (size_t)sb.st_size;
+	// An empty file isn't an error, but we can't mmap it.
+	if (length != 0) {
+		void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (FUNGE_UNLIKELY(map == MAP_FAILED)) {
+			int saved = errno;
+			diag_error_format("mmap() on file \"%s\" failed: %s", filename, strerror(errno));
+			close(fd);
+			errno = saved;
+			return NULL;
+		}
+		addr = map;
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+		posix_madvise(addr, length, POSIX_MADV_SEQUENTIAL);
+#endif
+	}
+
+	namelen = strlen(filename);
+	entry = malloc(sizeof(fileCacheEntry) + namelen + 1);
+	if (FUNGE_UNLIKELY(!entry)) {
+		DIAG_OOM("Couldn't allocate file cache entry");
+	}
+	entry->prev = entry->next = NULL;
+	entry->dev = sb.st_dev;
+	entry->ino = sb.st_ino;
+	entry->size = sb.st_size;
+	entry->mtime = sb.st_mtime;
+	entry->binary = binary;
+	memcpy(entry->filename, filename, namelen + 1);
+
+	if (length != 0) {
+		ncells = image_parse(&entry->image, addr, length, binary);
+	} else {
+		memset(&entry->image, 0, sizeof(fungeImage));
+		ncells = 0;
+	}
+	entry->bytes = sizeof(fileCacheEntry) + namelen + 1 + ncells
+	               + entry->image.nruns * sizeof(fungeImageRun);
+
+	if (addr)
+		munmap(addr, length);
+	close(fd);
+	return entry;
+}
+
+/// Make room for bytes more, returns false if it can't fit at all.
+FUNGE_ATTR_FAST
+static bool cache_make_room(size_t bytes)
+{
+	if (bytes > setting_file_cache_size)
+		return false;
+	while (cache_tail && cache_stats.bytes + bytes > setting_file_cache_size) {
+		entry_remove(cache_tail);
+		cache_stats.evictions++;
+	}
+	return true;
+}
+
+FUNGE_ATTR_FAST const fungeImage *
+filecache_get(const char * restrict filename, bool binary)
+{
+	struct stat sb;
+	fileCacheEntry *entry;
+
+	assert(filename != NULL);
+
+	entry_free(cache_uncached);
+	cache_uncached = NULL;
+
+	if (setting_file_cache_size != 0 && stat(filename, &sb) == 0) {
+		for (entry = cache_head; entry; entry = entry->next) {
+			if (entry->binary != binary || strcmp(entry->filename, filename) != 0)
+				continue;
+			if (entry->dev == sb.st_dev && entry->ino == sb.st_ino
+			    && entry->size == sb.st_size && entry->mtime == sb.st_mtime) {
+				cache_stats.hits++;
+				if (entry != cache_head) {
+					entry_unlink(entry);
+					entry_push_front(entry);
+				}
+				return &entry->image;
+			}
+			// Stale.
+			entry_remove(entry);
+			break;
+		}
+	}
+
+	cache_stats.misses++;
+	entry = entry_load(filename, binary);
+	if (!entry)
+		return NULL;
+	if (entry->mtime < time(NULL) - 1 && cache_make_room(entry->bytes)) {
+		entry_push_front(entry);
+		cache_stats.entries++;
+		cache_stats.bytes += entry->bytes;
+	} else {
+		cache_uncached = entry;
+	}
+	return &entry->image;
+}
+
+FUNGE_ATTR_FAST void
+filecache_forget(const char * restrict filename)
+{
+	fileCacheEntry *entry = cache_head;
+
+	assert(filename != NULL);
+
+	while (entry) {
+		fileCacheEntry *next = entry->next;
+		if (strcmp(entry->filename, filename) == 0)
+			entry_remove(entry);
+		entry = next;
+	}
+}
+
+void filecache_get_stats(fileCacheStats * restrict stats)
+{
+	assert(stats != NULL);
+	*stats = cache_stats;
+}
+
+FUNGE_ATTR_COLD
+void filecache_print_stats(void)
+{
+	fprintf(stderr, "File cache: %llu hits, %llu misses, %llu evictions, %zu files (%zu bytes) cached.\n",
+	        cache_stats.hits, cache_stats.misses, cache_stats.evictions,
+	        cache_stats.entries, cache_stats.bytes);
+}
+
+void filecache_free(void)
+{
+	while (cache_head)
+		entry_remove(cache_head);
+	entry_free(cache_uncached);
+	cache_uncached = NULL;
+}
@@ -0,0 +1,105 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * Cache of files parsed by the i instruction.
+ *
+ * A parsed file is stored as a list of runs of non-space cells, so loading it
+ * again is just a copy of each run into Funge-Space. Entries are keyed on
+ * filename, binary flag and the device, inode, size and mtime of the file,
+ * and the least recently used ones are evicted when the cache would grow
+ * beyond setting_file_cache_size bytes.
+ */
+
+#ifndef FUNGE_HAD_SRC_FUNGE_SPACE_FILE_CACHE_H
+#define FUNGE_HAD_SRC_FUNGE_SPACE_FILE_CACHE_H
+
+#include "../global.h"
+#include "../vector.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Default for setting_file_cache_size.
+#define FILECACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+
+/// A run of non-space cells on a single row.
+typedef struct fungeImageRun {
+	funge_vector pos;   ///< Position of the first cell, relative to load offset.
+	size_t       first; ///< Index of the first cell in fungeImage.cells.
+	size_t       len;   ///< Number of cells in the run.
+} fungeImageRun;
+
+/// A parsed file.
+typedef struct fungeImage {
+	funge_vector    size;  ///< Bounding rectangle, as returned by i.
+	size_t          nruns; ///< Number of entries in runs.
+	fungeImageRun * runs;
+	unsigned char * cells; ///< The cells of all runs, back to back.
+} fungeImage;
+
+/// Counters for the cache.
+typedef struct fileCacheStats {
+	unsigned long long hits;      ///< Loads served from the cache.
+	unsigned long long misses;    ///< Loads that had to parse the file.
+	unsigned long long evictions; ///< Entries dropped to stay within the cap.
+	size_t             entries;   ///< Files currently cached.
+	size_t             bytes;     ///< Memory used by cached files.
+} fileCacheStats;
+
+/**
+ * Get the parsed contents of a file, from the cache if possible.
+ * @param filename File to load.
+ * @param binary If true newlines are cells too, and the file is one row.
+ * @return The image, or NULL on error (with errno set). The image is valid
+ * until the next call to a filecache_* function.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+const fungeImage * filecache_get(const char * restrict filename, bool binary);
+
+/**
+ * Drop any cached images of a file. Used when we know we changed it.
+ * @param filename File to drop.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void filecache_forget(const char * restrict filename);
+
+/**
+ * Get the cache counters.
+ * @param stats Out parameter for the counters.
+ */
+FUNGE_ATTR_NONNULL
+void filecache_get_stats(fileCacheStats * restrict stats);
+
+/**
+ * Print the cache counters to stderr.
+ */
+FUNGE_ATTR_COLD
+void filecache_print_stats(void);
+
+/**
+ * Free all cached images.
+ */
+void filecache_free(void);
+
+#endif
@@ -30,14 +30,18 @@
 
 #include "../global.h"
 #include "funge-space.h"
+#include "file-cache.h"
+#include "heatmap.h"
 #include "../diagnostic.h"
+#include "../probes.h"
+#include "../stats.h"
 #include "../../lib/libghthash/ght_hash_table.h"
 #define CFUNGE_MEMPOOL_HASHLIB
 #include "../../lib/mempool/cfunge_mempool.h"
 
 #include <assert.h>
 #include <errno.h>
-#include <stdio.h>     /* fclose, fileno, fopen, fputs, fwrite, ... */
+#include <stdio.h>     /* fprintf, fputs */
 #include <stdlib.h>
 #include <string.h>    /* strerror */
 
@@ -52,6 +56,7 @@
 #endif
 
 #include <sys/mman.h>  /* mmap, munmap, posix_madvise */
+#include <sys/uio.h>   /* writev */
 
 /// Initial size for hash table (main)
 #define FUNGESPACE_INITIAL_SIZE 0x40000
@@ -92,14 +97,6 @@ static fungeSpace fspace = {
 };
 
 
-#define FUNGESPACE_STATIC_OFFSET_X 64
-#define FUNGESPACE_STATIC_OFFSET_Y 64
-// Note that this must be true to not break code below:
-//  (FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y * sizeof(funge_cell)) % 128 == 0
-// Further cfun_static_space must be aligned on 16 byte boundary.
-#define FUNGESPACE_STATIC_X 512
-#define FUNGESPACE_STATIC_Y 1024
-
 #define FUNGESPACE_RANGE_CHECK(rx, ry) \
 	(((rx) < FUNGESPACE_STATIC_X) && ((ry) < FUNGESPACE_STATIC_Y))
 #define STATIC_COORD(rx, ry) ((rx)+(ry)*FUNGESPACE_STATIC_X)
@@ -235,6 +232,7 @@ bool fungespace_create(void)
 
 void fungespace_free(void)
 {
+	filecache_free();
 	if (fspace.entries)
 		ght_fspace_finalize(fspace.entries);
 #ifdef CFUN_EXACT_BOUNDS
@@ -321,6 +319,7 @@ static inline void fungespace_minimize_bounds(void)
 	funge_cell minx, miny, maxx, maxy;
 	if (fspace.boundsexact)
 		return;
+	STATS_INC(minimize_bounds);
 
 	minx = fspace.topLeftCorner.x;
 	miny = fspace.topLeftCorner.y;
@@ -369,6 +368,7 @@ static inline void fungespace_minimize_bounds(void)
 	fspace.bottomRightCorner.x = maxx;
 	fspace.bottomRightCorner.y = maxy;
 	fspace.boundsexact = true;
+	FUNGE_PROBE4(bounds_minimize, minx, miny, maxx, maxy);
 }
 
 /**
@@ -483,9 +483,12 @@ fungespace_get(const funge_vector * restrict position)
 	funge_unsigned_cell y = (funge_unsigned_cell)position->y + FUNGESPACE_STATIC_OFFSET_Y;
 
 	if (FUNGESPACE_RANGE_CHECK(x, y)) {
+		STATS_INC(fspace_get_static);
 		return cfun_static_space[STATIC_COORD(x, y)];
 	} else {
-		funge_cell *tmp = (funge_cell*)ght_fspace_get(fspace.entries, position);
+		funge_cell *tmp;
+		STATS_INC(fspace_get_hash);
+		tmp = (funge_cell*)ght_fspace_get(fspace.entries, position);
 		if (!tmp)
 			return (funge_cell)' ';
 		else
@@ -507,13 +510,16 @@ fungespace_get_offset(const funge_vector * restrict position,
 
 	tmp.x = position->x + offset->x;
 	tmp.y = position->y + offset->y;
+	HEATMAP_COUNT(&tmp, heatREAD);
 
 	x = (funge_unsigned_cell)tmp.x + FUNGESPACE_STATIC_OFFSET_X;
 	y = (funge_unsigned_cell)tmp.y + FUNGESPACE_STATIC_OFFSET_Y;
 
 	if (FUNGESPACE_RANGE_CHECK(x, y)) {
+		STATS_INC(fspace_get_static);
 		return cfun_static_space[STATIC_COORD(x, y)];
 	} else {
+		STATS_INC(fspace_get_hash);
 		result = (funge_cell*)ght_fspace_get(fspace.entries, &tmp);
 		if (!result)
 			return (funge_cell)' ';
@@ -539,6 +545,7 @@ fungespace_set_no_bounds_update(funge_cell value,
 #ifdef CFUN_EXACT_BOUNDS
 		funge_cell prev = cfun_static_space[STATIC_COORD(x, y)];
 #endif
+		STATS_INC(fspace_set_static);
 		cfun_static_space[STATIC_COORD(x, y)] = value;
 #ifdef CFUN_EXACT_BOUNDS
 		if (value != prev) {
@@ -548,16 +555,20 @@ fungespace_set_no_bounds_update(funge_cell value,
 #endif
 	} else {
 #ifdef CFUN_EXACT_BOUNDS
-		funge_cell* prev = ght_fspace_get(fspace.entries, position);
+		funge_cell* prev;
+		STATS_INC(fspace_set_hash);
+		prev = ght_fspace_get(fspace.entries, position);
 		if (!prev) {
 			if (value == ' ')
 				return;
+			FUNGE_PROBE2(fspace_hash_insert, position->x, position->y);
 			if (FUNGE_UNLIKELY(ght_fspace_insert(fspace.entries, value, position) == -1)) {
 				DIAG_FATAL_LOC("Internal error: insert in hash table failed when value known not to exist.");
 			}
 			fungespace_count(true, position);
 		} else {
 			if (value == ' ') {
+				FUNGE_PROBE2(fspace_hash_remove, position->x, position->y);
 				ght_fspace_remove(fspace.entries, position);
 				fungespace_count(false, position);
 			} else {
@@ -565,7 +576,9 @@ fungespace_set_no_bounds_update(funge_cell value,
 			}
 		}
 #else
+		STATS_INC(fspace_set_hash);
 		if (value == ' ') {
+			FUNGE_PROBE2(fspace_hash_remove, position->x, position->y);
 			ght_fspace_remove(fspace.entries, position);
 		} else {
 			// Reuse cell if it exists
@@ -573,6 +586,7 @@ fungespace_set_no_bounds_update(funge_cell value,
 			if ((tmp = (funge_cell*)ght_fspace_get(fspace.entries, position)) != NULL) {
 				*tmp = value;
 			} else {
+				FUNGE_PROBE2(fspace_hash_insert, position->x, position->y);
 				if (FUNGE_UNLIKELY(ght_fspace_insert(fspace.entries, value, position) == -1)) {
 					DIAG_FATAL_LOC("Internal error: insert in hash table failed when value known not to exist.");
 				}
@@ -587,6 +601,7 @@ FUNGE_ATTR_FAST void
 fungespace_set(funge_cell value, const funge_vector * restrict position)
 {
 	assert(position != NULL);
+	FUNGE_PROBE3(fspace_set, position->x, position->y, value);
 	if (value != ' ') {
 		// It is faster to not use else if here, because this way the code
 		// translates into conditional moves (on x86 at least).
@@ -636,10 +651,15 @@ fungespace_set_offset(funge_cell value,
                       const funge_vector * restrict position,
                       const funge_vector * restrict offset)
 {
+	funge_vector tmp;
+
 	assert(position != NULL);
 	assert(offset != NULL);
 
-	fungespace_set(value, vector_create_ref(position->x + offset->x, position->y + offset->y));
+	tmp.x = position->x + offset->x;
+	tmp.y = position->y + offset->y;
+	HEATMAP_COUNT(&tmp, heatWRITE);
+	fungespace_set(value, &tmp);
 }
 
 
@@ -715,6 +735,7 @@ fungespace_wrap(funge_vector * restrict position,
 		fungespace_minimize_bounds();
 #endif
 	if (!fungespace_in_range(position)) {
+		STATS_INC(wraps);
 		// Quick and dirty if cardinal.
 		if (FUNGE_LIKELY(fspace_vector_is_cardinal(delta))) {
 			// FIXME, HACK: Why are the +1/-1 needed?
@@ -904,12 +925,45 @@ fungespace_load(const char * restrict filename)
 }
 
 
-/// Macro for handling newlines.
-#define FUNGE_OFFSET_NEWLINE \
-	if (pos.x > size->x) \
-		size->x = pos.x; \
-	pos.x = 0; \
-	pos.y++;
+/**
+ * Store a run of cells on a single row. Like calling fungespace_set() for each
+ * cell, but with only one bounds update and a plain copy when the whole run is
+ * in the static area.
+ * Must NOT be called with spaces in values.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void fungespace_set_run(const unsigned char * restrict values,
+                                      size_t count,
+                                      const funge_vector * restrict position)
+{
+	funge_unsigned_cell x = (funge_unsigned_cell)position->x + FUNGESPACE_STATIC_OFFSET_X;
+	funge_unsigned_cell y = (funge_unsigned_cell)position->y + FUNGESPACE_STATIC_OFFSET_Y;
+	funge_cell lastx = position->x + (funge_cell)count - 1;
+
+	if (fspace.bottomRightCorner.y < position->y)
+		fspace.bottomRightCorner.y = position->y;
+	if (fspace.topLeftCorner.y > position->y)
+		fspace.topLeftCorner.y = position->y;
+	if (fspace.bottomRightCorner.x < lastx)
+		fspace.bottomRightCorner.x = lastx;
+	if (fspace.topLeftCorner.x > position->x)
+		fspace.topLeftCorner.x = position->x;
+
+	if (FUNGESPACE_RANGE_CHECK(x, y) && count <= FUNGESPACE_STATIC_X - x) {
+		funge_cell * restrict dst = &cfun_static_space[STATIC_COORD(x, y)];
+		for (size_t i = 0; i < count; i++) {
+#ifdef CFUN_EXACT_BOUNDS
+			if (dst[i] == ' ')
+				fungespace_count(true, vector_create_ref(position->x + (funge_cell)i, position->y));
+#endif
+			dst[i] = (funge_cell)values[i];
+		}
+	} else {
+		for (size_t i = 0; i < count; i++)
+			fungespace_set_no_bounds_update((funge_cell)values[i],
+			                                vector_create_ref(position->x + (funge_cell)i, position->y));
+	}
+}
 
 FUNGE_ATTR_FAST bool
 fungespace_load_at_offset(const char         * restrict filename,
@@ -917,70 +971,264 @@ fungespace_load_at_offset(const char         * restrict filename,
                           funge_vector       * restrict size,
                           bool binary)
 {
-	unsigned char *addr;
-	int fd;
-	size_t length;
-	funge_vector pos = {0, 0};
+	const fungeImage *image;
 
 	assert(filename != NULL);
 	assert(offset != NULL);
 	assert(size != NULL);
 
-	fd = do_mmap(filename, &addr, &length);
-	if (FUNGE_UNLIKELY(fd == -1))
+	image = filecache_get(filename, binary);
+	if (FUNGE_UNLIKELY(!image))
 		return false;
 
-	// Set size here, we have to initialise it for both empty-file and normal
-	// load.
-	size->x = 0;
-	size->y = 0;
+	for (size_t i = 0; i < image->nruns; i++) {
+		const fungeImageRun *run = &image->runs[i];
+		fungespace_set_run(image->cells + run->first, run->len,
+		                   vector_create_ref(run->pos.x + offset->x, run->pos.y + offset->y));
+	}
+	*size = image->size;
+	// Binary mode has always given the end position instead (0, 0 for an
+	// empty file), with negative coordinates clamped to 0. Keep doing that.
+	if (binary && size->x != 0) {
+		size->x += offset->x;
+		size->y = offset->y;
+		if (size->x < 0)
+			size->x = 0;
+		if (size->y < 0)
+			size->y = 0;
+	}
+	return true;
+}
 
-	// Empty file?
-	if (FUNGE_UNLIKELY(fd == -2))
-		return true;
+/**************
+ * Row access *
+ **************/
 
-	if (binary) {
-		pos.x = offset->x;
-		pos.y = offset->y;
-		for (size_t i = 0; i < length; i++) {
-			if (addr[i] != ' ')
-				fungespace_set((funge_cell)addr[i], &pos);
-			pos.x++;
+/**
+ * Get a span of cells on one row. Copies straight from the static area where
+ * possible and doesn't look up anything outside the bounds.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void fungespace_get_span(funge_cell * restrict dst,
+                                       funge_cell x, funge_cell y, size_t count)
+{
+	size_t i = 0;
+	funge_unsigned_cell sy = (funge_unsigned_cell)y + FUNGESPACE_STATIC_OFFSET_Y;
+
+	if (y < fspace.topLeftCorner.y || y > fspace.bottomRightCorner.y) {
+		for (; i < count; i++)
+			dst[i] = ' ';
+		return;
+	}
+	while (i < count) {
+		funge_cell cx = (funge_cell)((funge_unsigned_cell)x + i);
+		funge_unsigned_cell sx = (funge_unsigned_cell)cx + FUNGESPACE_STATIC_OFFSET_X;
+		if (sy < FUNGESPACE_STATIC_Y && sx < FUNGESPACE_STATIC_X) {
+			size_t n = FUNGESPACE_STATIC_X - sx;
+			if (n > count - i)
+				n = count - i;
+			memcpy(dst + i, &cfun_static_space[STATIC_COORD(sx, sy)], n * sizeof(funge_cell));
+			i += n;
+		} else if (cx < fspace.topLeftCorner.x || cx > fspace.bottomRightCorner.x) {
+			dst[i++] = ' ';
+		} else {
+			funge_cell *tmp = (funge_cell*)ght_fspace_get(fspace.entries, vector_create_ref(cx, y));
+			dst[i++] = tmp ? *tmp : (funge_cell)' ';
 		}
-	} else {
-		bool lastwascr = false;
-		for (size_t i = 0; i < length; i++) {
-			switch (addr[i]) {
-				// Ignore form feed. Treat it as newline is treated in Unefunge.
-				case '\f':
-					break;
-				case '\r':
-					if (lastwascr) {
-						// Blergh two \r after each other.
-						FUNGE_OFFSET_NEWLINE
-					}
-					lastwascr = true;
-					break;
-				case '\n':
-					FUNGE_OFFSET_NEWLINE
-					lastwascr = false;
-					break;
-				default:
-					if (lastwascr) {
-						lastwascr = false;
-						FUNGE_OFFSET_NEWLINE
-					}
-					if (addr[i] != ' ')
-						fungespace_set_offset((funge_cell)addr[i], &pos, offset);
-					pos.x++;
-					break;
+	}
+}
+
+FUNGE_ATTR_FAST void
+fungespace_get_bytes(unsigned char * restrict dst, size_t count,
+                     const funge_vector * restrict position)
+{
+	funge_cell x = position->x;
+	funge_cell y = position->y;
+	size_t i = 0;
+	funge_unsigned_cell sy = (funge_unsigned_cell)y + FUNGESPACE_STATIC_OFFSET_Y;
+
+	assert(dst != NULL);
+	assert(position != NULL);
+
+	if (y < fspace.topLeftCorner.y || y > fspace.bottomRightCorner.y) {
+		memset(dst, ' ', count);
+		return;
+	}
+	while (i < count) {
+		funge_cell cx = (funge_cell)((funge_unsigned_cell)x + i);
+		funge_unsigned_cell sx = (funge_unsigned_cell)cx + FUNGESPACE_STATIC_OFFSET_X;
+		if (sy < FUNGESPACE_STATIC_Y && sx < FUNGESPACE_STATIC_X) {
+			const funge_cell * restrict src = &cfun_static_space[STATIC_COORD(sx, sy)];
+			size_t n = FUNGESPACE_STATIC_X - sx;
+			if (n > count - i)
+				n = count - i;
+			for (size_t k = 0; k < n; k++)
+				dst[i + k] = (unsigned char)src[k];
+			i += n;
+		} else if (cx < fspace.topLeftCorner.x || cx > fspace.bottomRightCorner.x) {
+			dst[i++] = ' ';
+		} else {
+			funge_cell *tmp = (funge_cell*)ght_fspace_get(fspace.entries, vector_create_ref(cx, y));
+			dst[i++] = tmp ? (unsigned char)*tmp : (unsigned char)' ';
+		}
+	}
+}
+
+FUNGE_ATTR_FAST void
+fungespace_set_bytes(const unsigned char * restrict src, size_t count,
+                     const funge_vector * restrict position)
+{
+	funge_cell x = position->x;
+	funge_cell y = position->y;
+	size_t first = 0, last = count;
+	size_t i = 0;
+	funge_unsigned_cell sy = (funge_unsigned_cell)y + FUNGESPACE_STATIC_OFFSET_Y;
+
+	assert(src != NULL);
+	assert(position != NULL);
+
+	// Bounds only grow to include the non-space bytes, same as fungespace_set().
+	while (first < count && src[first] == ' ')
+		first++;
+	if (first < count) {
+		funge_cell firstx, lastx;
+		while (src[last - 1] == ' ')
+			last--;
+		firstx = x + (funge_cell)first;
+		lastx = x + (funge_cell)(last - 1);
+		if (fspace.bottomRightCorner.y < y)
+			fspace.bottomRightCorner.y = y;
+		if (fspace.topLeftCorner.y > y)
+			fspace.topLeftCorner.y = y;
+		if (fspace.bottomRightCorner.x < lastx)
+			fspace.bottomRightCorner.x = lastx;
+		if (fspace.topLeftCorner.x > firstx)
+			fspace.topLeftCorner.x = firstx;
+	}
+
+	while (i < count) {
+		funge_cell cx = (funge_cell)((funge_unsigned_cell)x + i);
+		funge_unsigned_cell sx = (funge_unsigned_cell)cx + FUNGESPACE_STATIC_OFFSET_X;
+		if (sy < FUNGESPACE_STATIC_Y && sx < FUNGESPACE_STATIC_X) {
+			funge_cell * restrict dst = &cfun_static_space[STATIC_COORD(sx, sy)];
+			size_t n = FUNGESPACE_STATIC_X - sx;
+			if (n > count - i)
+				n = count - i;
+			for (size_t k = 0; k < n; k++) {
+				funge_cell value = (funge_cell)src[i + k];
+#ifdef CFUN_EXACT_BOUNDS
+				funge_cell prev = dst[k];
+				if (value != prev && (prev == ' ' || value == ' '))
+					fungespace_count(value != ' ', vector_create_ref(cx + (funge_cell)k, y));
+#endif
+				dst[k] = value;
 			}
+			i += n;
+		} else {
+			fungespace_set_no_bounds_update((funge_cell)src[i], vector_create_ref(cx, y));
+			i++;
 		}
-		if (lastwascr) pos.y++;
 	}
-	if (pos.x > size->x) size->x = pos.x;
-	if (pos.y > size->y) size->y = pos.y;
-	do_mmap_cleanup(fd, addr, length);
+}
+
+
+/*
+ * File writing for o. Rows are read a chunk at a time into a small array, and
+ * converted into a fixed size buffer. Runs of spaces and newlines are not
+ * copied, they are counted and emitted as iovecs pointing at static blocks once
+ * we know they aren't trailing. Nothing here grows with the size of the area.
+ */
+
+/// Cells read from Funge-Space at a time.
+#define SAVE_CHUNK_CELLS 1024
+/// Size of the byte buffer.
+#define SAVE_BUFFER_SIZE 0x10000
+/// Max number of iovecs collected before calling writev().
+#define SAVE_MAX_IOV 64
+/// Size of the blocks of spaces and newlines.
+#define SAVE_FILL_SIZE 1024
+
+typedef struct saveWriter {
+	int           fd;
+	size_t        used;  ///< Bytes used in buf.
+	size_t        start; ///< Start of bytes in buf not yet added to iov.
+	int           niov;
+	struct iovec  iov[SAVE_MAX_IOV];
+	unsigned char buf[SAVE_BUFFER_SIZE];
+} saveWriter;
+
+static saveWriter save_writer;
+static unsigned char save_spaces[SAVE_FILL_SIZE];
+static unsigned char save_newlines[SAVE_FILL_SIZE];
+
+/// Write out everything collected so far.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool save_flush(saveWriter * restrict w)
+{
+	struct iovec *iov = w->iov;
+	int niov;
+
+	if (w->used > w->start) {
+		w->iov[w->niov].iov_base = w->buf + w->start;
+		w->iov[w->niov].iov_len = w->used - w->start;
+		w->niov++;
+	}
+	niov = w->niov;
+	w->used = w->start = 0;
+	w->niov = 0;
+
+	while (niov > 0) {
+		ssize_t written = writev(w->fd, iov, niov);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		// Skip what was written, handling partial writes.
+		while (niov > 0 && (size_t)written >= iov->iov_len) {
+			written -= (ssize_t)iov->iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov > 0) {
+			iov->iov_base = (unsigned char*)iov->iov_base + written;
+			iov->iov_len -= (size_t)written;
+		}
+	}
+	return true;
+}
+
+/// Add count bytes from a static fill block without copying them.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool save_fill(saveWriter * restrict w, unsigned char * restrict block, size_t count)
+{
+	while (count > 0) {
+		size_t n = count < SAVE_FILL_SIZE ? count : SAVE_FILL_SIZE;
+		// Need room for the pending buffer bytes and the fill, and for the
+		// pending buffer bytes in save_flush() after that.
+		if (w->niov > SAVE_MAX_IOV - 3 && !save_flush(w))
+			return false;
+		if (w->used > w->start) {
+			w->iov[w->niov].iov_base = w->buf + w->start;
+			w->iov[w->niov].iov_len = w->used - w->start;
+			w->niov++;
+			w->start = w->used;
+		}
+		w->iov[w->niov].iov_base = block;
+		w->iov[w->niov].iov_len = n;
+		w->niov++;
+		count -= n;
+	}
+	return true;
+}
+
+/// Add one byte.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline bool save_byte(saveWriter * restrict w, unsigned char c)
+{
+	w->buf[w->used++] = c;
+	if (FUNGE_UNLIKELY(w->used == SAVE_BUFFER_SIZE))
+		return save_flush(w);
 	return true;
 }
 
@@ -990,10 +1238,13 @@ fungespace_save_to_file(const char         * restrict filename,
                         const funge_vector * restrict size,
                         bool textfile)
 {
-	FILE * file;
-
+	saveWriter * restrict w = &save_writer;
+	funge_cell row[SAVE_CHUNK_CELLS];
+	// Spaces and newlines not written yet, in text mode they are dropped if
+	// nothing else follows them.
+	size_t spaces = 0, newlines = 0;
 	funge_cell maxy = offset->y + size->y;
-	funge_cell maxx = offset->x + size->x;
+	int fd;
 
 	assert(filename != NULL);
 	assert(offset != NULL);
@@ -1001,85 +1252,108 @@ fungespace_save_to_file(const char         * restrict filename,
 	assert(size->x > 0);
 	assert(size->y > 0);
 
-	file = fopen(filename, "wb");
-	if (!file)
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
 		return false;
+	filecache_forget(filename);
+
+	if (FUNGE_UNLIKELY(save_spaces[0] != ' ')) {
+		memset(save_spaces, ' ', sizeof(save_spaces));
+		memset(save_newlines, '\n', sizeof(save_newlines));
+	}
+	w->fd = fd;
+	w->used = w->start = 0;
+	w->niov = 0;
 
 	if (!textfile) {
 		// Microoptimising! Remove this if it bothers you.
 		// However it also makes it possible to error out early.
 #if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
-		if (posix_fallocate(fileno(file), 0, (off_t)(size->y * size->x)) != 0) {
+		if (posix_fallocate(fd, 0, (off_t)(size->y * size->x)) != 0) {
 			goto error;
 		}
 #endif
-		for (funge_cell y = offset->y; y < maxy; y++) {
-			for (funge_cell x = offset->x; x < maxx; x++) {
-				funge_cell value = fungespace_get(vector_create_ref(x, y));
-				cf_putc_unlocked((int)value, file);
-			}
-			cf_putc_unlocked('\n', file);
-		}
-	// Text mode...
-	} else {
-		size_t index = 0;
-		// Extra size->y for adding a lot of \n...
-		unsigned char * restrict towrite = malloc((size_t)(size->x * size->y + size->y) * sizeof(unsigned char));
-		funge_cell * restrict string;
-
-		if (!towrite) {
-			goto error;
-		}
-		// Construct each line.
-		string = malloc((size_t)size->x * sizeof(funge_cell));
-		for (funge_cell y = offset->y; y < maxy; y++) {
-			ssize_t lastspace = (ssize_t)size->x;
-			if (!string) {
-				free(towrite);
-				goto error;
-			}
-			for (funge_cell x = offset->x; x < maxx; x++) {
-				string[x - offset->x] = fungespace_get(vector_create_ref(x, y));
-			}
-
-			do {
-				lastspace--;
-			} while ((lastspace >= 0) && (string[lastspace] == ' '));
+	}
 
-			for (ssize_t i = 0; i <= lastspace; i++) {
-				towrite[index + (size_t)i] = (unsigned char)string[i];
+	for (funge_cell y = offset->y; y < maxy; y++) {
+		for (funge_cell done = 0; done < size->x; ) {
+			size_t n = (size_t)(size->x - done);
+			if (n > SAVE_CHUNK_CELLS)
+				n = SAVE_CHUNK_CELLS;
+			fungespace_get_span(row, offset->x + done, y, n);
+			done += (funge_cell)n;
+
+			if (!textfile) {
+				for (size_t i = 0; i < n; i++) {
+					if (!save_byte(w, (unsigned char)row[i]))
+						goto error;
+				}
+				continue;
 			}
-			index += (size_t)(lastspace + 1);
-			towrite[index] = (funge_cell)'\n';
-			index++;
-		}
-		free(string);
-		// Remove trailing newlines.
-		{
-			ssize_t lastnewline = (ssize_t)index;
-			do {
-				lastnewline--;
-			} while ((lastnewline >= 0) && (towrite[lastnewline] == '\n'));
-
-			if (lastnewline > 0) {
-				size_t retval = fwrite(towrite, sizeof(unsigned char), (size_t)(lastnewline + 1), file);
-				if (retval != (size_t)lastnewline + 1) {
-					free(towrite);
+			for (size_t i = 0; i < n; i++) {
+				unsigned char c = (unsigned char)row[i];
+				if (row[i] == ' ') {
+					spaces++;
+					continue;
+				}
+				if (newlines && (spaces || c != '\n')) {
+					if (!save_fill(w, save_newlines, newlines))
+						goto error;
+					newlines = 0;
+				}
+				if (spaces) {
+					if (!save_fill(w, save_spaces, spaces))
+						goto error;
+					spaces = 0;
+				}
+				// A newline cell counts as a trailing newline too.
+				if (c == '\n') {
+					newlines++;
+				} else if (!save_byte(w, c)) {
 					goto error;
 				}
 			}
 		}
-		free(towrite);
+		if (textfile) {
+			// Trailing spaces are dropped.
+			spaces = 0;
+			newlines++;
+		} else if (!save_byte(w, '\n')) {
+			goto error;
+		}
 	}
-	fclose(file);
+	if (!save_flush(w))
+		goto error;
+	close(fd);
 	return true;
 error:
-	if (file)
-		fclose(file);
+	close(fd);
 	return false;
 }
 
 
+#ifdef ENABLE_STATS
+FUNGE_ATTR_COLD void
+fungespace_hash_stats(fungeSpaceHashStats * restrict out)
+{
+	const ght_fspace_hash_table_t * table = fspace.entries;
+
+	out->entries = table->i_items;
+	out->buckets = table->i_size;
+	out->chains = 0;
+	out->longest_chain = 0;
+	for (size_t i = 0; i < table->i_size; i++) {
+		size_t length = (size_t)table->p_nr[i];
+		if (length == 0)
+			continue;
+		out->chains++;
+		if (length > out->longest_chain)
+			out->longest_chain = length;
+	}
+}
+#endif
+
+
 /*************
  * Debugging *
  *************/
@@ -37,6 +37,15 @@
 /// Yes I mean you!
 typedef funge_vector fungeSpaceHashKey;
 
+/// Where the static part of Funge-Space starts, relative to (0,0).
+#define FUNGESPACE_STATIC_OFFSET_X 64
+#define FUNGESPACE_STATIC_OFFSET_Y 64
+// Note that this must be true to not break code in funge-space.c:
+//  (FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y * sizeof(funge_cell)) % 128 == 0
+// Further cfun_static_space must be aligned on 16 byte boundary.
+#define FUNGESPACE_STATIC_X 512
+#define FUNGESPACE_STATIC_Y 1024
+
 /**
  * Create a Funge-space.
  * @warning Should only be called from internal setup code.
@@ -148,6 +157,31 @@ bool fungespace_save_to_file(const char         * restrict filename,
                              const funge_vector * restrict size,
                              bool textfile);
 
+/// Good size for buffers used with fungespace_get_bytes() and
+/// fungespace_set_bytes() when transferring data in pieces.
+#define FUNGESPACE_TILE_SIZE 4096
+
+/**
+ * Get a row of cells as bytes, like calling fungespace_get() for each cell
+ * and truncating the values to unsigned char.
+ * @param dst Where to store the bytes.
+ * @param count Number of cells to get.
+ * @param position First cell to get, the rest follow in positive x.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_get_bytes(unsigned char * restrict dst, size_t count,
+                          const funge_vector * restrict position);
+/**
+ * Store bytes in a row of cells, like calling fungespace_set() for each byte
+ * but with only one bounds update.
+ * @param src Bytes to store.
+ * @param count Number of bytes.
+ * @param position Where to store the first byte, the rest follow in positive x.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_set_bytes(const unsigned char * restrict src, size_t count,
+                          const funge_vector * restrict position);
+
 /**
  * Get the bounding rectangle for the part of Funge-Space that isn't empty.
  * @note It won't be too small, but it may be too big.
@@ -156,4 +190,20 @@ bool fungespace_save_to_file(const char         * restrict filename,
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 void fungespace_get_bounds_rect(fungeRect * restrict rect);
 
+#ifdef ENABLE_STATS
+/// Shape of the hash table, for -x.
+typedef struct fungeSpaceHashStats {
+	size_t entries;       ///< Cells stored in the hash table.
+	size_t buckets;       ///< Size of the bucket array.
+	size_t chains;        ///< Buckets with at least one entry.
+	size_t longest_chain; ///< Entries in the fullest bucket.
+} fungeSpaceHashStats;
+
+/**
+ * Walk the hash table and fill in out.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+void fungespace_hash_stats(fungeSpaceHashStats * restrict out);
+#endif
+
 #endif
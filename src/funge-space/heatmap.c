@@ -0,0 +1,334 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../global.h"
+#include "heatmap.h"
+#include "funge-space.h"
+#include "../diagnostic.h"
+#include "../rect.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Initial size of the hash table, must be a power of two.
+#define HEATMAP_HASH_MIN 1024
+/// Don't write images larger than this many pixels.
+#define HEATMAP_MAX_PIXELS (16 * 1024 * 1024)
+
+typedef struct heatmapCounts {
+	uint64_t count[3]; ///< Indexed by heatmapKind.
+} heatmapCounts;
+
+/// Entry in the hash table. Free if all counts are zero.
+typedef struct heatmapEntry {
+	funge_vector  pos;
+	heatmapCounts counts;
+} heatmapEntry;
+
+/// For the output, one cell with non-zero counts.
+typedef struct heatmapCell {
+	funge_vector          pos;
+	const heatmapCounts * counts;
+} heatmapCell;
+
+bool heatmap_enabled = false;
+
+/// Counts for the static part of Funge-Space, the hash table has the rest.
+static heatmapCounts * heatmap_dense = NULL;
+static heatmapEntry  * heatmap_hash = NULL;
+static size_t          heatmap_hash_size = 0;
+static size_t          heatmap_hash_used = 0;
+static char          * heatmap_prefix = NULL;
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline size_t heatmap_hash_index(funge_cell x, funge_cell y, size_t size)
+{
+	uint64_t h = (uint64_t)x * UINT64_C(0x9E3779B97F4A7C15)
+	             ^ (uint64_t)y * UINT64_C(0xC2B2AE3D27D4EB4F);
+	return (size_t)(h ^ (h >> 32)) & (size - 1);
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline bool heatmap_entry_free(const heatmapEntry * restrict entry)
+{
+	return (entry->counts.count[heatEXEC] | entry->counts.count[heatREAD]
+	        | entry->counts.count[heatWRITE]) == 0;
+}
+
+/// Find the slot for pos in table, either the one holding it or a free one.
+FUNGE_ATTR_FAST
+static heatmapEntry * heatmap_hash_slot(heatmapEntry * restrict table, size_t size,
+                                        const funge_vector * restrict pos)
+{
+	size_t i = heatmap_hash_index(pos->x, pos->y, size);
+	while (true) {
+		heatmapEntry * entry = &table[i];
+		if (heatmap_entry_free(entry)
+		    || (entry->pos.x == pos->x && entry->pos.y == pos->y))
+			return entry;
+		i = (i + 1) & (size - 1);
+	}
+}
+
+FUNGE_ATTR_NOINLINE
+static void heatmap_hash_grow(void)
+{
+	size_t newsize = heatmap_hash_size * 2;
+	heatmapEntry * newtable = calloc(newsize, sizeof(heatmapEntry));
+
+	if (FUNGE_UNLIKELY(!newtable)) {
+		DIAG_OOM("Couldn't grow heatmap");
+	}
+	for (size_t i = 0; i < heatmap_hash_size; i++) {
+		if (!heatmap_entry_free(&heatmap_hash[i]))
+			*heatmap_hash_slot(newtable, newsize, &heatmap_hash[i].pos) = heatmap_hash[i];
+	}
+	free(heatmap_hash);
+	heatmap_hash = newtable;
+	heatmap_hash_size = newsize;
+}
+
+FUNGE_ATTR_FAST void
+heatmap_count(const funge_vector * restrict position, heatmapKind kind)
+{
+	funge_unsigned_cell x = (funge_unsigned_cell)position->x + FUNGESPACE_STATIC_OFFSET_X;
+	funge_unsigned_cell y = (funge_unsigned_cell)position->y + FUNGESPACE_STATIC_OFFSET_Y;
+	heatmapEntry * entry;
+
+	if (FUNGE_LIKELY(x < FUNGESPACE_STATIC_X && y < FUNGESPACE_STATIC_Y)) {
+		heatmap_dense[x + y * FUNGESPACE_STATIC_X].count[kind]++;
+		return;
+	}
+	// Keep the load at most 1/2.
+	if (FUNGE_UNLIKELY((heatmap_hash_used + 1) * 2 > heatmap_hash_size))
+		heatmap_hash_grow();
+	entry = heatmap_hash_slot(heatmap_hash, heatmap_hash_size, position);
+	if (heatmap_entry_free(entry)) {
+		entry->pos = *position;
+		heatmap_hash_used++;
+	}
+	entry->counts.count[kind]++;
+}
+
+
+/**********
+ * Output *
+ **********/
+
+static int heatmap_cell_compare(const void * a, const void * b)
+{
+	const heatmapCell * ca = a;
+	const heatmapCell * cb = b;
+	if (ca->pos.y != cb->pos.y)
+		return (ca->pos.y < cb->pos.y) ? -1 : 1;
+	if (ca->pos.x != cb->pos.x)
+		return (ca->pos.x < cb->pos.x) ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Collect all cells with non-zero counts, sorted by y then x.
+ * @return Array (caller frees) or NULL if out of memory.
+ */
+static heatmapCell * heatmap_collect(size_t * restrict count)
+{
+	size_t n = 0, size = 1024;
+	heatmapCell * cells = malloc(size * sizeof(heatmapCell));
+
+	if (!cells)
+		return NULL;
+	for (size_t i = 0; i < FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y + heatmap_hash_size; i++) {
+		heatmapCell cell;
+		if (i < FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y) {
+			const heatmapCounts * c = &heatmap_dense[i];
+			if ((c->count[heatEXEC] | c->count[heatREAD] | c->count[heatWRITE]) == 0)
+				continue;
+			cell.pos.x = (funge_cell)(i % FUNGESPACE_STATIC_X) - FUNGESPACE_STATIC_OFFSET_X;
+			cell.pos.y = (funge_cell)(i / FUNGESPACE_STATIC_X) - FUNGESPACE_STATIC_OFFSET_Y;
+			cell.counts = c;
+		} else {
+			const heatmapEntry * e = &heatmap_hash[i - FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y];
+			if (heatmap_entry_free(e))
+				continue;
+			cell.pos = e->pos;
+			cell.counts = &e->counts;
+		}
+		if (n == size) {
+			heatmapCell * tmp = realloc(cells, size * 2 * sizeof(heatmapCell));
+			if (!tmp) {
+				free(cells);
+				return NULL;
+			}
+			cells = tmp;
+			size *= 2;
+		}
+		cells[n++] = cell;
+	}
+	qsort(cells, n, sizeof(heatmapCell), &heatmap_cell_compare);
+	*count = n;
+	return cells;
+}
+
+static bool heatmap_write_csv(const char * restrict filename,
+                              const heatmapCell * restrict cells, size_t count)
+{
+	FILE * f = fopen(filename, "w");
+
+	if (!f)
+		return false;
+	fputs("x,y,cell,executed,read,written\n", f);
+	for (size_t i = 0; i < count; i++) {
+		fprintf(f, "%" FUNGECELLPRI ",%" FUNGECELLPRI ",%" FUNGECELLPRI
+		        ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+		        cells[i].pos.x, cells[i].pos.y, fungespace_get(&cells[i].pos),
+		        cells[i].counts->count[heatEXEC], cells[i].counts->count[heatREAD],
+		        cells[i].counts->count[heatWRITE]);
+	}
+	return fclose(f) == 0;
+}
+
+/// Number of bits needed for n, used as a log scale.
+FUNGE_ATTR_CONST
+static unsigned int heatmap_bits(uint64_t n)
+{
+	unsigned int bits = 0;
+	while (n) {
+		bits++;
+		n >>= 1;
+	}
+	return bits;
+}
+
+/**
+ * One pixel per cell: red for executed, blue for read, green for written, on
+ * a log scale. Cells that aren't spaces get a grey base, so the program text
+ * shows through.
+ */
+static bool heatmap_write_ppm(const char * restrict filename,
+                              const heatmapCell * restrict cells, size_t count)
+{
+	fungeRect rect;
+	funge_cell minx, miny, maxx, maxy;
+	unsigned int maxbits[3] = { 1, 1, 1 };
+	funge_unsigned_cell xspan, yspan;
+	size_t width, height, next = 0;
+	unsigned char * row;
+	FILE * f;
+
+	fungespace_get_bounds_rect(&rect);
+	minx = rect.x;
+	miny = rect.y;
+	maxx = rect.x + rect.w;
+	maxy = rect.y + rect.h;
+	for (size_t i = 0; i < count; i++) {
+		if (cells[i].pos.x < minx) minx = cells[i].pos.x;
+		if (cells[i].pos.y < miny) miny = cells[i].pos.y;
+		if (cells[i].pos.x > maxx) maxx = cells[i].pos.x;
+		if (cells[i].pos.y > maxy) maxy = cells[i].pos.y;
+		for (int k = 0; k < 3; k++) {
+			unsigned int bits = heatmap_bits(cells[i].counts->count[k]);
+			if (bits > maxbits[k])
+				maxbits[k] = bits;
+		}
+	}
+	// Cells can be further apart than funge_cell can count.
+	xspan = (funge_unsigned_cell)maxx - (funge_unsigned_cell)minx;
+	yspan = (funge_unsigned_cell)maxy - (funge_unsigned_cell)miny;
+	if (xspan >= HEATMAP_MAX_PIXELS || yspan >= HEATMAP_MAX_PIXELS
+	    || (size_t)xspan + 1 > HEATMAP_MAX_PIXELS / ((size_t)yspan + 1)) {
+		fputs("Funge-Space is too large for a heatmap image, only writing CSV.\n", stderr);
+		return true;
+	}
+	width = (size_t)xspan + 1;
+	height = (size_t)yspan + 1;
+
+	row = malloc(width * 3);
+	f = fopen(filename, "wb");
+	if (!row || !f) {
+		free(row);
+		if (f)
+			fclose(f);
+		return false;
+	}
+	fprintf(f, "P6\n%zu %zu\n255\n", width, height);
+	for (size_t j = 0; j < height; j++) {
+		funge_cell y = miny + (funge_cell)j;
+		for (size_t i = 0; i < width; i++) {
+			funge_vector pos = { minx + (funge_cell)i, y };
+			unsigned char base = (fungespace_get(&pos) != ' ') ? 64 : 0;
+			unsigned char * pixel = &row[i * 3];
+			pixel[0] = pixel[1] = pixel[2] = base;
+			if (next < count && cells[next].pos.y == y && cells[next].pos.x == pos.x) {
+				const uint64_t * c = cells[next].counts->count;
+				pixel[0] = (unsigned char)(base + heatmap_bits(c[heatEXEC]) * (255u - base) / maxbits[heatEXEC]);
+				pixel[1] = (unsigned char)(base + heatmap_bits(c[heatWRITE]) * (255u - base) / maxbits[heatWRITE]);
+				pixel[2] = (unsigned char)(base + heatmap_bits(c[heatREAD]) * (255u - base) / maxbits[heatREAD]);
+				next++;
+			}
+		}
+		fwrite(row, 3, width, f);
+	}
+	free(row);
+	return fclose(f) == 0;
+}
+
+static void heatmap_write(void)
+{
+	size_t len = strlen(heatmap_prefix);
+	char * filename = malloc(len + sizeof(".csv"));
+	size_t count = 0;
+	heatmapCell * cells = heatmap_collect(&count);
+
+	if (!filename || !cells) {
+		fputs("Out of memory when writing heatmap.\n", stderr);
+	} else {
+		memcpy(filename, heatmap_prefix, len);
+		memcpy(filename + len, ".csv", sizeof(".csv"));
+		if (!heatmap_write_csv(filename, cells, count))
+			fprintf(stderr, "Failed to write heatmap to \"%s\": %s\n", filename, strerror(errno));
+		memcpy(filename + len, ".ppm", sizeof(".ppm"));
+		if (!heatmap_write_ppm(filename, cells, count))
+			fprintf(stderr, "Failed to write heatmap to \"%s\": %s\n", filename, strerror(errno));
+	}
+	free(cells);
+	free(filename);
+	free(heatmap_dense);
+	free(heatmap_hash);
+	free(heatmap_prefix);
+	heatmap_enabled = false;
+}
+
+void heatmap_setup(const char * restrict prefix)
+{
+	heatmap_prefix = strdup(prefix);
+	heatmap_dense = calloc(FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y, sizeof(heatmapCounts));
+	heatmap_hash_size = HEATMAP_HASH_MIN;
+	heatmap_hash = calloc(heatmap_hash_size, sizeof(heatmapEntry));
+	if (FUNGE_UNLIKELY(!heatmap_prefix || !heatmap_dense || !heatmap_hash)) {
+		DIAG_OOM("Couldn't allocate heatmap");
+	}
+	heatmap_enabled = true;
+	atexit(&heatmap_write);
+}
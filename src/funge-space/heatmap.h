@@ -0,0 +1,70 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Per-cell execution heatmap (-H option).
+ *
+ * Counts how many times each cell is executed, read with g and written with
+ * p, in a shadow of Funge-Space: a dense array over the same window as the
+ * static part of Funge-Space and a hash table for everything else. At exit
+ * the counts are written as CSV and as a PPM image over the program text.
+ *
+ * When -H isn't given the hooks cost one predictable branch each.
+ */
+
+#ifndef FUNGE_HAD_SRC_FUNGE_SPACE_HEATMAP_H
+#define FUNGE_HAD_SRC_FUNGE_SPACE_HEATMAP_H
+
+#include "../global.h"
+#include "../vector.h"
+
+#include <stdbool.h>
+
+typedef enum heatmapKind {
+	heatEXEC  = 0, ///< Executed as an instruction.
+	heatREAD  = 1, ///< Read with g.
+	heatWRITE = 2  ///< Written with p.
+} heatmapKind;
+
+/// True if -H was given. Use the HEATMAP_COUNT() macro, not this directly.
+extern bool heatmap_enabled;
+
+/**
+ * Allocate the shadow and register the writer to run at exit.
+ * @param prefix Output goes to prefix.csv and prefix.ppm.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+void heatmap_setup(const char * restrict prefix);
+
+/**
+ * Count one event for a cell.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void heatmap_count(const funge_vector * restrict position, heatmapKind kind);
+
+#define HEATMAP_COUNT(position, kind) \
+	do { \
+		if (FUNGE_UNLIKELY(heatmap_enabled)) \
+			heatmap_count((position), (kind)); \
+	} while (0)
+
+#endif
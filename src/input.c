@@ -21,49 +21,173 @@
 
 #include "global.h"
 #include "input.h"
+#include "iobackend.h"
+#include "output.h"
 
 #include <assert.h>
 #include <ctype.h>  /* isdigit, isxdigit */
+#include <limits.h> /* UCHAR_MAX */
 #include <stdbool.h>
 #include <stddef.h> /* ptrdiff_t */
 #include <stdlib.h>
+#include <string.h> /* memchr, memcpy, memmove */
+#include <unistd.h> /* isatty, lseek */
 
-// We use static buffer for input to save input
-// from one read to the next if there was any
-// left.
-static char*  lastline = NULL;
-// Size of buffer, may be grown by cf_getline()
-static size_t linesize = 0;
-// Length of current string in buffer. Needed in case of \0 bytes in it
-static size_t linelength = 0;
+#include <sys/types.h>
+#include <sys/stat.h>  /* fstat */
+#include <sys/mman.h>  /* mmap, posix_madvise */
+
+/*
+ * Input is handled one line at a time, and we keep the rest of the line
+ * around from one read to the next if there was any left.
+ *
+ * Input is read from the io_input backend in large blocks (or mmap()ed if it
+ * is a regular file), and the lines are just pointers into that. A read from
+ * a terminal returns at most one line anyway.
+ */
+
+/// Initial size of block buffer.
+#define INPUT_BLOCK_SIZE (64 * 1024)
+
+// The current line. Not NUL terminated.
+static const char* line = NULL;
+// Length of current line. Needed in case of \0 bytes in it
+static size_t      linelength = 0;
 // Pointer to how far we consumed the current line.
-static char*  lastline_current = NULL;
+static const char* line_current = NULL;
+
+#define IS_LINE_END(ptr) ((size_t)((ptr)-line) >= linelength)
 
-#define IS_LINE_END(ptr) ((size_t)((ptr)-lastline) >= linelength)
+static enum {
+	inputUnknown = 0, ///< Not decided yet.
+	inputInteractive, ///< Input is a terminal, always flush output first.
+	inputBatch        ///< Only flush output first if there is any.
+} input_mode = inputUnknown;
+
+/// Block buffer.
+static struct {
+	char * data;
+	size_t size;   ///< Allocated size of data, 0 if it is mmap()ed.
+	size_t start;  ///< First byte not handed out as a line yet.
+	size_t end;    ///< End of valid data.
+	bool   eof;    ///< Nothing more to read.
+} input_block;
+
+/// Decide how to read input. Called at first read.
+FUNGE_ATTR_NOINLINE FUNGE_ATTR_COLD
+static void select_mode(void)
+{
+	struct stat sb;
+	int fd = io_input->fd;
+
+	if (fd >= 0 && isatty(fd)) {
+		input_mode = inputInteractive;
+		return;
+	}
+	input_mode = inputBatch;
+	// Map regular files in one go, starting where the fd is now.
+	if (fd >= 0 && fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+		off_t offset = lseek(fd, 0, SEEK_CUR);
+		if (offset >= 0 && offset < sb.st_size) {
+			void *addr = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE,
+			                  fd, 0);
+			if (addr != MAP_FAILED) {
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+				posix_madvise(addr, (size_t)sb.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+				input_block.data = addr;
+				input_block.start = (size_t)offset;
+				input_block.end = (size_t)sb.st_size;
+				input_block.eof = true;
+				// We consumed it all, as far as anyone else is concerned.
+				lseek(fd, 0, SEEK_END);
+			}
+		}
+	}
+}
+
+/// Read more data into the block buffer, moving unconsumed data to the start.
+FUNGE_ATTR_FAST
+static void block_fill(void)
+{
+	ssize_t n;
+
+	if (input_block.start > 0) {
+		memmove(input_block.data, input_block.data + input_block.start,
+		        input_block.end - input_block.start);
+		input_block.end -= input_block.start;
+		input_block.start = 0;
+	}
+	// First read, or line longer than the buffer.
+	if (input_block.end == input_block.size) {
+		size_t newsize = input_block.size ? input_block.size * 2 : INPUT_BLOCK_SIZE;
+		char *newdata = realloc(input_block.data, newsize);
+		if (FUNGE_UNLIKELY(!newdata)) {
+			input_block.eof = true;
+			return;
+		}
+		input_block.data = newdata;
+		input_block.size = newsize;
+	}
+	n = io_input->read(io_input, input_block.data + input_block.end,
+	                   input_block.size - input_block.end);
+	if (n <= 0)
+		input_block.eof = true;
+	else
+		input_block.end += (size_t)n;
+}
+
+/// Hand out the next line of the block buffer.
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static bool block_next_line(void)
+{
+	size_t scanned = 0;
+
+	while (true) {
+		const char *start = input_block.data + input_block.start;
+		size_t available = input_block.end - input_block.start;
+		const char *newline = available ? memchr(start + scanned, '\n', available - scanned) : NULL;
+		if (newline) {
+			linelength = (size_t)(newline - start) + 1;
+			break;
+		}
+		if (input_block.eof) {
+			// Last line, without a newline.
+			if (available == 0)
+				return false;
+			linelength = available;
+			break;
+		}
+		scanned = available;
+		block_fill();
+	}
+	line = input_block.data + input_block.start;
+	input_block.start += linelength;
+	return true;
+}
 
 FUNGE_ATTR_WARN_UNUSED
 static inline bool get_line(void)
 {
-	if (!lastline || !lastline_current || IS_LINE_END(lastline_current)) {
-		ssize_t retval;
-		fflush(stdout);
-		retval = cf_getline(&lastline, &linesize, stdin);
-		if (retval == -1)
+	if (!line || !line_current || IS_LINE_END(line_current)) {
+		if (FUNGE_UNLIKELY(input_mode == inputUnknown))
+			select_mode();
+		// Also flushes stdio, in case something (like TERM) used it. Batch
+		// jobs only bother if there is something to flush.
+		if (input_mode == inputInteractive || output_pending())
+			(void)output_flush();
+		if (!block_next_line())
 			return false;
-		lastline_current = lastline;
-		linelength = retval;
+		line_current = line;
 	}
 	return true;
 }
 
 static inline void discard_line(void)
 {
-	if (lastline != NULL)
-		free(lastline);
-	lastline = NULL;
+	line = NULL;
 	linelength = 0;
-	linesize = 0;
-	lastline_current = NULL;
+	line_current = NULL;
 }
 
 
@@ -72,9 +196,9 @@ FUNGE_ATTR_FAST bool input_getchar(funge_cell * restrict chr)
 	unsigned char tmp;
 	if (!get_line())
 		return false;
-	tmp = *((unsigned char*)lastline_current);
-	lastline_current++;
-	if (lastline_current && IS_LINE_END(lastline_current))
+	tmp = *((const unsigned char*)line_current);
+	line_current++;
+	if (IS_LINE_END(line_current))
 		discard_line();
 	*chr = (funge_cell)tmp;
 	return true;
@@ -82,16 +206,36 @@ FUNGE_ATTR_FAST bool input_getchar(funge_cell * restrict chr)
 
 FUNGE_ATTR_FAST bool input_getline(unsigned char ** str)
 {
+	size_t len;
+	const char *nul;
 	if (!get_line())
 		return false;
-	// TODO: How to handle zero bytes?
-	*str = (unsigned char*)strdup(lastline_current);
+	// TODO: How to handle zero bytes? For now we stop at them.
+	len = linelength - (size_t)(line_current - line);
+	nul = memchr(line_current, '\0', len);
+	if (nul)
+		len = (size_t)(nul - line_current);
+	*str = malloc(len + 1);
+	if (*str) {
+		memcpy(*str, line_current, len);
+		(*str)[len] = '\0';
+	}
 	discard_line();
 	return true;
 }
 
 
-static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+/// Value + 1 of each digit, 0 for anything that isn't a digit in any base.
+static const unsigned char digit_values[UCHAR_MAX + 1] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6,
+	['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10, ['a'] = 11, ['b'] = 12,
+	['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16, ['g'] = 17, ['h'] = 18,
+	['i'] = 19, ['j'] = 20, ['k'] = 21, ['l'] = 22, ['m'] = 23, ['n'] = 24,
+	['o'] = 25, ['p'] = 26, ['q'] = 27, ['r'] = 28, ['s'] = 29, ['t'] = 30,
+	['u'] = 31, ['v'] = 32, ['w'] = 33, ['x'] = 34, ['y'] = 35, ['z'] = 36
+};
+
+#define DIGIT_VALUE(m_c) ((funge_cell)digit_values[(unsigned char)(m_c)] - 1)
 
 // Start of s as if it is in base.
 // Unlike strtoll this does not clamp on overflow but stop reading just before
@@ -110,25 +254,15 @@ static inline ptrdiff_t parse_int(const char * restrict s,
 	assert(s != NULL);
 	assert(value != NULL);
 
-	for (i = 0; i <= length; i++) {
-		// Will it overflow?
-		if (result > (FUNGECELL_MAX / base))
+	for (i = 0; i < length; i++) {
+		funge_cell tmp = DIGIT_VALUE(s[i]);
+		// Still a digit?
+		if (tmp < 0 || tmp >= base)
 			break;
-		{
-			funge_cell tmp;
-			char c = s[i];
-			// Pointer into digits.
-			const char *p = strchr(digits, c);
-			// Still a digit?
-			if (!p || ((p - digits) >= (ptrdiff_t) base))
-				break;
-
-			tmp = (funge_cell) (p - digits);
-			// Break if it will overflow!
-			if ((result * base) > (FUNGECELL_MAX - tmp))
-				break;
-			result = (result * base) + tmp;
-		}
+		// Break if it will overflow!
+		if (result > (FUNGECELL_MAX / base) || (result * base) > (FUNGECELL_MAX - tmp))
+			break;
+		result = (result * base) + tmp;
 	}
 	*value = result;
 	return (ptrdiff_t)i;
@@ -138,36 +272,39 @@ static inline ptrdiff_t parse_int(const char * restrict s,
 // bound anyway.
 FUNGE_ATTR_FAST ret_getint input_getint(funge_cell * restrict value, int base)
 {
-	bool found = false;
-	char * endptr = NULL;
+	const char * end;
+	const char * endptr;
 	assert(value != NULL);
 
 	if (!get_line())
 		return rgi_eof;
+	end = line + linelength;
 	// Find first char that is a number, then convert number.
-	do {
+	for (; line_current < end; line_current++) {
+		unsigned char c = (unsigned char)*line_current;
 		if (base == 10) {
-			if (!isdigit(*lastline_current))
-				continue;
+			if (isdigit(c))
+				break;
 		} else if (base == 16) {
-			if (!isxdigit(*lastline_current))
-				continue;
+			if (isxdigit(c))
+				break;
 		} else {
-			const char * p = strchr(digits, *lastline_current);
-			if (!p || ((p - digits) >= (ptrdiff_t)base))
-				continue;
+			funge_cell digit = DIGIT_VALUE(c);
+			if (digit >= 0 && digit < base)
+				break;
 		}
-		found = true;
-		// Ok, we found it, lets convert it.
-		endptr = lastline_current
-		         + parse_int(lastline_current, value, (funge_cell)base,
-		                     lastline_current - lastline + linelength);
-		break;
-	} while ((size_t)((lastline_current++) - lastline) < linelength);
+	}
+	if (line_current == end) {
+		discard_line();
+		return rgi_noint;
+	}
+	// Ok, we found it, lets convert it.
+	endptr = line_current + parse_int(line_current, value, (funge_cell)base,
+	                                  (size_t)(end - line_current));
 	// Discard rest of line if it is just newline, otherwise keep it.
-	if (endptr && ((*endptr == '\n') || (*endptr == '\r') || IS_LINE_END(endptr)))
+	if (endptr == end || (*endptr == '\n') || (*endptr == '\r'))
 		discard_line();
 	else
-		lastline_current = endptr;
-	return found ? rgi_success : rgi_noint;
+		line_current = endptr;
+	return rgi_success;
 }
@@ -23,17 +23,158 @@
 #include "execute.h"
 #include "../stack.h"
 #include "../ip.h"
+#include "../iobackend.h"
+#include "../output.h"
 #include "../settings.h"
+#include "../coprocess.h"
+#include "../../lib/stringbuffer/stringbuffer.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 // On empty string
 #define FUNGE_NOCOMMAND (-2)
 
+/// Copy everything the command writes to the pipe into our output.
+FUNGE_ATTR_FAST
+static void copy_to_output(int fd)
+{
+	unsigned char buf[4096];
+
+	while (true) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		(void)output_write(buf, (size_t)n);
+	}
+}
+
+/**
+ * Run command with /bin/sh like system() does, but with posix_spawn() so we
+ * don't fork the whole interpreter.
+ * @return Wait status, or -1 if the shell could not be started.
+ */
+FUNGE_ATTR_FAST
+static int run_spawned(char * restrict command)
+{
+	// Not string literals, as argv is not const.
+	static char arg_sh[] = "sh";
+	static char arg_c[] = "-c";
+	char * const arguments[] = { arg_sh, arg_c, command, NULL };
+	int outfd = io_output->fd;
+	int outpipe[2] = { -1, -1 };
+	pid_t pid;
+	int status;
+
+	// The command's output goes to the output backend too. If that isn't a
+	// file descriptor the command can write to, pass it on through a pipe.
+	if (outfd == -1) {
+		if (!coprocess_pipe(outpipe))
+			return -1;
+		outfd = outpipe[1];
+	}
+	if (outfd == STDOUT_FILENO)
+		pid = coprocess_spawn("/bin/sh", arguments);
+	else
+		pid = coprocess_spawn_redirect("/bin/sh", arguments, STDOUT_FILENO, outfd);
+	if (outpipe[0] != -1) {
+		close(outpipe[1]);
+		if (pid != -1)
+			copy_to_output(outpipe[0]);
+		close(outpipe[0]);
+	}
+	if (pid == -1)
+		return -1;
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR)
+			return -1;
+	}
+	return status;
+}
+
+/*
+ * Long-running shell (-C option). It reads commands on its stdin and writes
+ * each exit status on fd 3. The real stdin is kept on fd 4 for the commands.
+ * Each command is run in a subshell, so like with system() nothing it does
+ * (cd, variables, exit) carries over to the next one. A command killed by a
+ * signal gives 128 + signal number, as $? does in the shell.
+ */
+static coprocess shell_worker = COPROCESS_INIT;
+
+static void shell_worker_stop(void)
+{
+	coprocess_stop(&shell_worker);
+}
+
+/// Build the line for the shell: ( eval 'command' ) ...; echo $? >&3
+FUNGE_ATTR_FAST
+static char * shell_worker_line(const char * restrict command, size_t * restrict length)
+{
+	StringBuffer * sb = stringbuffer_new();
+
+	if (!sb)
+		return NULL;
+	stringbuffer_append_string(sb, "( eval '");
+	for (const char * c = command; *c != '\0'; c++) {
+		if (*c == '\'')
+			stringbuffer_append_string(sb, "'\\''");
+		else
+			stringbuffer_append_char(sb, *c);
+	}
+	stringbuffer_append_string(sb, "' ) 0<&4 3>&- 4>&-; echo $? >&3\n");
+	return stringbuffer_finish(sb, length);
+}
+
+/**
+ * Run command in the long-running shell, starting it if needed.
+ * @return Exit status, or -1 on failure.
+ */
+FUNGE_ATTR_FAST
+static funge_cell run_in_shell_worker(const char * restrict command)
+{
+	static bool registered = false;
+	unsigned long status;
+	size_t length;
+	char * line = shell_worker_line(command, &length);
+	bool sent = false;
+
+	if (!line)
+		return -1;
+	// A failed write means the shell never saw the command, so one retry with
+	// a new shell is safe.
+	for (int attempt = 0; attempt < 2 && !sent; attempt++) {
+		if (!coprocess_alive(&shell_worker)) {
+			static char arg_sh[] = "sh";
+			char * const arguments[] = { arg_sh, NULL };
+			if (!coprocess_start(&shell_worker, "/bin/sh", arguments, 0, 3, 4))
+				break;
+			if (!registered) {
+				atexit(&shell_worker_stop);
+				registered = true;
+			}
+		}
+		sent = coprocess_send(&shell_worker, line, length);
+		if (!sent)
+			coprocess_stop(&shell_worker);
+	}
+	free(line);
+	if (!sent)
+		return -1;
+	if (!coprocess_read_number(&shell_worker, &status)) {
+		// Shell died under us. Next call starts a new one.
+		coprocess_stop(&shell_worker);
+		return -1;
+	}
+	return (funge_cell)status;
+}
+
 FUNGE_ATTR_FAST void run_system_execute(instructionPointer * restrict ip)
 {
 	assert(ip != NULL);
@@ -47,22 +188,28 @@ FUNGE_ATTR_FAST void run_system_execute(instructionPointer * restrict ip)
 		char * restrict command;
 		int retval;
 		// Pop stuff.
-		command = (char*)stack_pop_string(ip->stack, NULL);
+		command = (char*)stack_pop_string_scratch(ip->stack, NULL, 0);
 
 		// Sanity test!
 		if (!command || (*command == '\0')) {
-			stack_free_string(command);
 			stack_push(ip->stack, FUNGE_NOCOMMAND);
 			return;
 		}
 
-		retval = system(command);
+		// The command may print too.
+		(void)output_flush();
+		// The long-running shell writes to our fd 1, so only use it when that
+		// is where output goes.
+		if (setting_persistent_coprocess && io_output->fd == STDOUT_FILENO) {
+			stack_push(ip->stack, run_in_shell_worker(command));
+			return;
+		}
+		retval = run_spawned(command);
 		// POSIX says we may only use WEXITSTATUS if WIFEXITED returns true...
 		if (WIFEXITED(retval)) {
 			stack_push(ip->stack, (funge_cell)WEXITSTATUS(retval));
 		} else {
 			stack_push(ip->stack, (funge_cell)retval);
 		}
-		stack_free_string(command);
 	}
 }
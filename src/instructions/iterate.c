@@ -23,6 +23,7 @@
 #include "iterate.h"
 #include "../interpreter.h"
 #include "../funge-space/funge-space.h"
+#include "../funge-space/heatmap.h"
 #include "../vector.h"
 #include "../stack.h"
 #include "../ip.h"
@@ -177,6 +178,7 @@ static FUNGE_ATTR_FAST void run_iterate_implement(instructionPointer * restrict
 #ifndef DISABLE_TRACE
 					print_trace(iters, kInstr);
 #endif /* DISABLE_TRACE */
+					HEATMAP_COUNT(&posinstr, heatEXEC);
 
 					switch (kInstr) {
 #ifdef CONCURRENT_FUNGE
@@ -27,6 +27,7 @@
 #include "../ip.h"
 #include "../main.h"                    /* fungeargc, fungeargv */
 #include "../rect.h"
+#include "../replay.h"
 #include "../settings.h"
 #include "../stack.h"
 #include "../vector.h"
@@ -239,7 +240,7 @@ static void push_all(instructionPointer * restrict ip, funge_stack * restrict pu
 
 	PUSH_REQ_18(pushStack, ip->stackstack);
 	PUSH_REQ_17(pushStack, ip);
-	now = time(NULL);
+	now = (time_t)replay_value(replayTIME, (int64_t)time(NULL));
 	gmtime_r(&now, &curTime);
 	PUSH_REQ_16(pushStack, curTime);
 	PUSH_REQ_15(pushStack, curTime);
@@ -353,7 +354,7 @@ static void push_yval(funge_cell request, instructionPointer * restrict ip, fung
 		case 20: { // Date ((year - 1900) * 256 * 256) + (month * 256) + (day of month)
 			time_t now;
 			struct tm curTime;
-			now = time(NULL);
+			now = (time_t)replay_value(replayTIME, (int64_t)time(NULL));
 			gmtime_r(&now, &curTime);
 			PUSH_REQ_15(pushStack, curTime);
 			break;
@@ -361,7 +362,7 @@ static void push_yval(funge_cell request, instructionPointer * restrict ip, fung
 		case 21: { // Time (hour * 256 * 256) + (minute * 256) + (second)
 			time_t now;
 			struct tm curTime;
-			now = time(NULL);
+			now = (time_t)replay_value(replayTIME, (int64_t)time(NULL));
 			gmtime_r(&now, &curTime);
 			PUSH_REQ_16(pushStack, curTime);
 			break;
@@ -402,7 +403,7 @@ void run_sys_info(instructionPointer *ip)
 		// TODO: We can pre-calculate this really, if we have the env cache
 		// stack size + number of stack-stacks.
 		if (sysinfo_tmp_stack->top >= (size_t)request) {
-			stack_push(ip->stack, sysinfo_tmp_stack->entries[sysinfo_tmp_stack->top - (size_t)request]);
+			stack_push(ip->stack, stack_get_index(sysinfo_tmp_stack, sysinfo_tmp_stack->top + 1 - (size_t)request));
 		} else {
 			// Act as pick
 			stack_push(ip->stack, stack_get_index(ip->stack, ip->stack->top + 1 - (request - sysinfo_tmp_stack->top)));
@@ -24,12 +24,22 @@
 
 #include "diagnostic.h"
 #include "division.h"
+#include "funge-space/file-cache.h"
 #include "funge-space/funge-space.h"
+#include "funge-space/heatmap.h"
 #include "input.h"
 #include "ip.h"
+#include "output.h"
+#include "parallel.h"
 #include "prng.h"
+#include "probes.h"
+#include "reactor.h"
+#include "replay.h"
+#include "sampler.h"
 #include "settings.h"
 #include "stack.h"
+#include "stats.h"
+#include "trace.h"
 #include "vector.h"
 
 #include "fingerprints/manager.h"
@@ -40,6 +50,7 @@
 #include "instructions/sysinfo.h"
 
 #include <errno.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -147,9 +158,11 @@ static inline void handle_fprint(funge_cell opcode, instructionPointer * restric
 		int_fast8_t entry = (int_fast8_t)(opcode - 'A');
 		if ((ip->fingerOpcodes[entry].top > 0)
 		    && ip->fingerOpcodes[entry].entries[ip->fingerOpcodes[entry].top - 1]) {
+			STATS_INC(fingerprint_calls[entry]);
 			// Call the fingerprint.
 			ip->fingerOpcodes[entry].entries[ip->fingerOpcodes[entry].top - 1](ip);
 		} else {
+			STATS_INC(fingerprint_missing);
 			warn_unknown_instr(opcode, ip);
 			ip_reverse(ip);
 		}
@@ -164,13 +177,16 @@ FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPo
 {
 	// First check if we are in string mode, and do special stuff then.
 	if (ip->mode == ipmSTRING) {
+		STATS_INC(string_mode);
 		return_if_con(handle_string_mode(opcode, ip));
 	// Next: Is this a fingerprint opcode?
 	} else if ((opcode >= 'A') && (opcode <= 'Z')) {
+		STATS_OPCODE(opcode);
 		handle_fprint(opcode, ip);
 	// OK a core instruction.
 	// Find what one and execute it.
 	} else {
+		STATS_OPCODE(opcode);
 		switch (opcode) {
 			case ' ': {
 #ifdef AFL_FUZZ_TESTING
@@ -232,9 +248,7 @@ FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPo
 				break;
 			}
 			case '?': {
-				// May not be perfectly uniform.
-				// If this matters for you, contact me (with a patch).
-				funge_unsigned_cell rnd = prng_generate_unsigned(4);
+				funge_unsigned_cell rnd = prng_generate_unsigned(&ip->prng, 4);
 				switch (rnd) {
 					case 0: ip_go_north(ip); break;
 					case 1: ip_go_east(ip); break;
@@ -401,13 +415,13 @@ FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPo
 			case ',': {
 				funge_cell a = stack_pop(ip->stack);
 				// Reverse on failed output
-				if (FUNGE_UNLIKELY(cf_putchar_unlocked((int)a) != (unsigned char)a))
+				if (FUNGE_UNLIKELY(!output_putchar((unsigned char)a)))
 					ip_reverse(ip);
 				break;
 			}
 			case '.':
 				// Reverse on failed output
-				if (FUNGE_UNLIKELY(printf("%" FUNGECELLPRI " ", stack_pop(ip->stack)) < 0))
+				if (FUNGE_UNLIKELY(!output_cell(stack_pop(ip->stack))))
 					ip_reverse(ip);
 				break;
 
@@ -538,7 +552,6 @@ FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPo
 			case '@':
 #ifdef CONCURRENT_FUNGE
 				if (IPList->top == 0) {
-					fflush(stdout);
 					exit(0);
 				} else {
 					*threadindex = iplist_terminate_ip(&IPList, *threadindex);
@@ -585,13 +598,172 @@ static inline void thread_forward(instructionPointer * restrict ip)
 #endif
 
 
-FUNGE_ATTR_NORET
-static inline void interpreter_main_loop(void)
+#ifdef CONCURRENT_FUNGE
+/// Number of turns (runs of one or more ticks by the same IP) in quantum mode.
+static unsigned long long quantum_turns = 0;
+/// Number of ticks executed in quantum mode.
+static unsigned long long quantum_ticks = 0;
+
+/// Print statistics for -Q at exit.
+static void quantum_print_stats(void)
+{
+	fprintf(stderr, "Quantum %u: %llu ticks in %llu turns, %llu IP switches saved.\n",
+	        setting_quantum, quantum_ticks, quantum_turns, quantum_ticks - quantum_turns);
+}
+#endif
+
+#ifdef PARALLEL_FUNGE
+/// Batches smaller than this are executed sequentially, not worth the overhead.
+#  define PARALLEL_MIN_BATCH 256
+/// Largest batch to build.
+#  define PARALLEL_MAX_BATCH 8192
+/// Max number of p per batch, we check for conflicts with a linear search.
+#  define PARALLEL_MAX_WRITES 64
+
+/// Should we try to use the parallel scheduler?
+static bool parallel_enabled = false;
+/// Tasks for current batch.
+static parallelTask *parallel_batch = NULL;
+/// Cells written by p in current batch.
+static funge_vector parallel_writes[PARALLEL_MAX_WRITES];
+
+/**
+ * Check if an instruction only touches the stacks of the IP (or is g/p), so
+ * that it can be executed in parallel with other IPs. Anything that moves the
+ * IP (and thus might wrap), does IO, uses global state or changes the IP list
+ * is excluded.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline bool parallel_is_safe(funge_cell opcode, const instructionPointer * restrict ip)
+{
+	// More than one space in string mode takes no tick.
+	if (ip->mode == ipmSTRING)
+		return opcode != ' ';
+	if ((opcode >= '0' && opcode <= '9') || (opcode >= 'a' && opcode <= 'f'))
+		return true;
+	switch (opcode) {
+		case '+': case '-': case '*': case '/': case '%': case '!': case '`':
+		case ':': case '\\': case '$': case 'n':
+		case '<': case '>': case '^': case 'v': case 'r': case '[': case ']':
+		case 'x': case '_': case '|': case 'w': case 'z': case '"':
+		case 'g': case 'p': case '?':
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// Get the vector g or p would pop, without popping it.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline funge_vector parallel_peek_vector(const instructionPointer * restrict ip)
+{
+	const funge_stack * stack = ip->stack;
+	funge_vector result = { 0, 0 };
+	if (stack->top >= 1)
+		result.y = stack_get_index(stack, stack->top);
+	if (stack->top >= 2)
+		result.x = stack_get_index(stack, stack->top - 1);
+	result.x += ip->storageOffset.x;
+	result.y += ip->storageOffset.y;
+	return result;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline bool parallel_is_written(const funge_vector * restrict pos, size_t nwrites)
+{
+	for (size_t i = 0; i < nwrites; i++)
+		if (parallel_writes[i].x == pos->x && parallel_writes[i].y == pos->y)
+			return true;
+	return false;
+}
+
+/**
+ * Try to execute IPs i, i-1, ... in parallel.
+ * The batch ends at the first IP that isn't safe, or that would read a cell
+ * (either as instruction or using g) written by an earlier IP in the batch.
+ * Then the writes are committed and the IPs moved in IP order, so the result
+ * is the same as for the sequential main loop.
+ * @return Number of IPs that can be run in a row. If this is less than
+ * PARALLEL_MIN_BATCH nothing was executed and the caller should execute that
+ * many (or at least one) IPs sequentially.
+ */
+FUNGE_ATTR_FAST
+static size_t parallel_try_batch(ssize_t i)
+{
+	size_t count = 0;
+	size_t nwrites = 0;
+
+	while (i >= 0 && count < PARALLEL_MAX_BATCH) {
+#  ifdef LARGE_IPLIST
+		instructionPointer *ip = IPList->ips[i];
+#  else
+		instructionPointer *ip = &IPList->ips[i];
+#  endif
+		funge_cell opcode = fungespace_get(&ip->position);
+
+		if (!parallel_is_safe(opcode, ip))
+			break;
+		if (parallel_is_written(&ip->position, nwrites))
+			break;
+		if (ip->mode == ipmCODE && opcode == 'g') {
+			funge_vector pos = parallel_peek_vector(ip);
+			if (parallel_is_written(&pos, nwrites))
+				break;
+		} else if (ip->mode == ipmCODE && opcode == 'p') {
+			if (nwrites == PARALLEL_MAX_WRITES)
+				break;
+			parallel_writes[nwrites++] = parallel_peek_vector(ip);
+		}
+		parallel_batch[count].ip = ip;
+		parallel_batch[count].opcode = opcode;
+		count++;
+		i--;
+	}
+	if (count < PARALLEL_MIN_BATCH)
+		return count;
+
+	parallel_execute(parallel_batch, count);
+
+	for (size_t k = 0; k < count; k++) {
+		if (parallel_batch[k].has_write)
+			fungespace_set(parallel_batch[k].write_value, &parallel_batch[k].write_pos);
+		thread_forward(parallel_batch[k].ip);
+	}
+	return count;
+}
+#endif /* PARALLEL_FUNGE */
+
+/// Set by SIGUSR2, makes the plain main loop return so we can switch to the
+/// instrumented one.
+static volatile sig_atomic_t interpreter_switch_requested = 0;
+
+#ifndef DISABLE_TRACE
+static void interpreter_switch_signal(int signum)
+{
+	(void)signum;
+	interpreter_switch_requested = 1;
+}
+#endif
+
+/**
+ * The main loop. This is instantiated twice: the instrumented version has the
+ * hooks for tracing, profiling, heatmap, statistics and record/replay, the
+ * plain version has none of them, and returns when a SIGUSR2 asks for tracing.
+ * @param instrumented Must be a constant.
+ */
+FUNGE_ATTR_ALWAYS_INLINE
+static inline void interpreter_main_loop(const bool instrumented)
 {
 #ifdef AFL_FUZZ_TESTING
 	long iterations = 1000;
 #endif
 #ifdef CONCURRENT_FUNGE
+	// Ticks left in the turn of the current IP, only used with -Q.
+	unsigned int quantum_left = setting_quantum;
+#    ifdef PARALLEL_FUNGE
+	// Number of IPs left to run sequentially before trying a new batch.
+	size_t sequential_run = 0;
+#    endif
 	while (true) {
 		ssize_t i = IPList->top;
 #    ifdef AFL_FUZZ_TESTING
@@ -600,6 +772,16 @@ static inline void interpreter_main_loop(void)
 		if (!iterations--)
 			exit(123);
 #    endif
+#    ifdef PARALLEL_FUNGE
+		sequential_run = 0;
+#    endif
+		if (FUNGE_UNLIKELY(reactor_parked != 0))
+			reactor_tick(IPList);
+		if (instrumented) {
+			STATS_POLL();
+		} else if (FUNGE_UNLIKELY(interpreter_switch_requested)) {
+			return;
+		}
 		while (i >= 0) {
 			bool retval;
 			funge_cell opcode;
@@ -607,15 +789,54 @@ static inline void interpreter_main_loop(void)
 			if (!thread_iterations--)
 				exit(123);
 #    endif
+			// Skip IPs waiting for a file descriptor.
+#    ifdef LARGE_IPLIST
+			if (FUNGE_UNLIKELY(reactor_parked != 0) && IPList->ips[i]->waitFd != -1) {
+#    else
+			if (FUNGE_UNLIKELY(reactor_parked != 0) && IPList->ips[i].waitFd != -1) {
+#    endif
+				quantum_left = setting_quantum;
+				i--;
+				continue;
+			}
+#    ifdef PARALLEL_FUNGE
+			if (FUNGE_UNLIKELY(parallel_enabled)) {
+				if (sequential_run == 0) {
+					size_t batch = parallel_try_batch(i);
+					if (batch >= PARALLEL_MIN_BATCH) {
+						i -= (ssize_t)batch;
+						continue;
+					}
+					sequential_run = batch ? batch : 1;
+				}
+				sequential_run--;
+			}
+#    endif
 
 #    ifdef LARGE_IPLIST
 			opcode = fungespace_get(&IPList->ips[i]->position);
+			FUNGE_PROBE4(instruction, IPList->ips[i]->ID, IPList->ips[i]->position.x,
+			             IPList->ips[i]->position.y, opcode);
+			if (instrumented) {
+				HEATMAP_COUNT(&IPList->ips[i]->position, heatEXEC);
+				SAMPLER_POLL(IPList->ips[i], opcode);
+				TRACE_RECORD(IPList->ips[i], i, opcode);
+				REPLAY_TICK();
+			}
 #    else
 			opcode = fungespace_get(&IPList->ips[i].position);
+			FUNGE_PROBE4(instruction, IPList->ips[i].ID, IPList->ips[i].position.x,
+			             IPList->ips[i].position.y, opcode);
+			if (instrumented) {
+				HEATMAP_COUNT(&IPList->ips[i].position, heatEXEC);
+				SAMPLER_POLL(&IPList->ips[i], opcode);
+				TRACE_RECORD(&IPList->ips[i], i, opcode);
+				REPLAY_TICK();
+			}
 #    endif
 
 #    if !defined(DISABLE_TRACE) && defined(LARGE_IPLIST)
-			if (FUNGE_UNLIKELY(setting_trace_level != 0)) {
+			if (instrumented && FUNGE_UNLIKELY(setting_trace_level != 0)) {
 				if (setting_trace_level > 8) {
 					fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
 					        i, IPList->ips[i]->ID, IPList->ips[i]->position.x,
@@ -629,7 +850,7 @@ static inline void interpreter_main_loop(void)
 					fprintf(stderr, "%c", (char)opcode);
 			}
 #    elif !defined(DISABLE_TRACE) && !defined(LARGE_IPLIST)
-			if (FUNGE_UNLIKELY(setting_trace_level != 0)) {
+			if (instrumented && FUNGE_UNLIKELY(setting_trace_level != 0)) {
 				if (setting_trace_level > 8) {
 					fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
 					        i, IPList->ips[i].ID, IPList->ips[i].position.x,
@@ -644,6 +865,29 @@ static inline void interpreter_main_loop(void)
 			}
 #    endif /* DISABLE_TRACE */
 
+			if (FUNGE_UNLIKELY(setting_quantum > 1)) {
+				ssize_t old_i = i;
+				size_t old_top = IPList->top;
+#    ifdef LARGE_IPLIST
+				retval = execute_instruction(opcode, IPList->ips[i], &i);
+				thread_forward(IPList->ips[i]);
+#    else
+				retval = execute_instruction(opcode, &IPList->ips[i], &i);
+				thread_forward(&IPList->ips[i]);
+#    endif
+				if (retval)
+					continue;
+				quantum_ticks++;
+				if (quantum_left == setting_quantum)
+					quantum_turns++;
+				// Keep going with the same IP, unless t or @ changed the list.
+				if (--quantum_left > 0 && i == old_i && IPList->top == old_top)
+					continue;
+				quantum_left = setting_quantum;
+				i--;
+				continue;
+			}
+
 #    ifdef LARGE_IPLIST
 			retval = execute_instruction(opcode, IPList->ips[i], &i);
 			thread_forward(IPList->ips[i]);
@@ -663,9 +907,21 @@ static inline void interpreter_main_loop(void)
 		if (!iterations--)
 			exit(123);
 #    endif
+		if (instrumented) {
+			STATS_POLL();
+		} else if (FUNGE_UNLIKELY(interpreter_switch_requested)) {
+			return;
+		}
 		opcode = fungespace_get(&IP->position);
+		FUNGE_PROBE4(instruction, IP->ID, IP->position.x, IP->position.y, opcode);
+		if (instrumented) {
+			HEATMAP_COUNT(&IP->position, heatEXEC);
+			SAMPLER_POLL(IP, opcode);
+			TRACE_RECORD(IP, -1, opcode);
+			REPLAY_TICK();
+		}
 #    ifndef DISABLE_TRACE
-		if (FUNGE_UNLIKELY(setting_trace_level != 0)) {
+		if (instrumented && FUNGE_UNLIKELY(setting_trace_level != 0)) {
 			if (setting_trace_level > 8) {
 				fprintf(stderr, "x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
 				        IP->position.x, IP->position.y, (char)opcode, opcode);
@@ -687,6 +943,35 @@ static inline void interpreter_main_loop(void)
 #endif /* CONCURRENT_FUNGE */
 }
 
+FUNGE_ATTR_NOINLINE
+static void interpreter_main_loop_plain(void)
+{
+	interpreter_main_loop(false);
+}
+
+FUNGE_ATTR_NOINLINE FUNGE_ATTR_NORET
+static void interpreter_main_loop_instrumented(void)
+{
+	interpreter_main_loop(true);
+	// Never reached, only the plain loop returns.
+	abort();
+}
+
+/// True if any option needs the hooks in the instrumented main loop.
+FUNGE_ATTR_PURE
+static bool interpreter_need_instrumented(void)
+{
+#ifdef ENABLE_STATS
+	if (setting_stats)
+		return true;
+#endif
+#ifndef DISABLE_TRACE
+	if (setting_trace_level != 0 || trace_enabled)
+		return true;
+#endif
+	return heatmap_enabled || sampler_enabled || replay_enabled;
+}
+
 
 #ifndef NDEBUG
 // Used with debugging for freeing stuff at end of the program.
@@ -738,6 +1023,25 @@ void interpreter_run(const char *filename)
 	atexit(&debug_free);
 #endif
 	prng_init();
+	output_setup();
+	if (setting_file_cache_stats)
+		atexit(&filecache_print_stats);
+#ifdef ENABLE_STATS
+	if (setting_stats)
+		stats_setup();
+#endif
+	if (setting_heatmap_prefix)
+		heatmap_setup(setting_heatmap_prefix);
+	if (setting_profile_file)
+		sampler_setup(setting_profile_file);
+	if (setting_record_file)
+		replay_setup(setting_record_file, true);
+	else if (setting_replay_file)
+		replay_setup(setting_replay_file, false);
+#ifndef DISABLE_TRACE
+	if (setting_trace_file)
+		trace_setup(setting_trace_file, setting_trace_ring);
+#endif
 #ifdef CFUN_KLEE_TEST_PROGRAM
 	klee_generate_program();
 #else
@@ -750,11 +1054,56 @@ void interpreter_run(const char *filename)
 	if (FUNGE_UNLIKELY(IPList == NULL)) {
 		DIAG_FATAL_LOC("Couldn't create instruction pointer list!?");
 	}
+	if (setting_quantum > 1)
+		atexit(&quantum_print_stats);
+#  ifdef PARALLEL_FUNGE
+	// Tracing prints or records in the middle of the tick, so doesn't mix with this.
+	// Batches are built from one tick of many IPs, so no quantum either.
+	// The heatmap isn't thread safe, and the profiler only samples sequential IPs.
+	// Record/replay needs the values in the same order every time.
+	// The -x counters aren't atomic, so counting would lose updates.
+	if (setting_parallel_threads > 1 && setting_trace_level == 0 && !setting_trace_file
+	    && setting_quantum <= 1 && !setting_heatmap_prefix && !setting_profile_file
+	    && !replay_enabled
+#    ifdef ENABLE_STATS
+	    && !setting_stats
+#    endif
+	   ) {
+		parallel_batch = malloc(PARALLEL_MAX_BATCH * sizeof(parallelTask));
+		if (FUNGE_UNLIKELY(!parallel_batch)) {
+			DIAG_OOM("Couldn't allocate parallel batch");
+		}
+		if (FUNGE_UNLIKELY(!parallel_setup(setting_parallel_threads)))
+			diag_warn("Failed to start all worker threads, using fewer.");
+		parallel_enabled = true;
+	}
+#  endif
 #else
 	IP = ip_create();
 	if (FUNGE_UNLIKELY(IP == NULL)) {
 		DIAG_FATAL_LOC("Couldn't create instruction pointer!?");
 	}
 #endif
-	interpreter_main_loop();
+#ifndef DISABLE_TRACE
+	if (!interpreter_need_instrumented()) {
+		struct sigaction action;
+		action.sa_handler = &interpreter_switch_signal;
+		sigemptyset(&action.sa_mask);
+		action.sa_flags = SA_RESTART;
+		sigaction(SIGUSR2, &action, NULL);
+		interpreter_main_loop_plain();
+		// Got SIGUSR2, start tracing from here.
+		if (setting_trace_level == 0)
+			setting_trace_level = 4;
+#  ifdef PARALLEL_FUNGE
+		// Tracing doesn't mix with batches, same as when starting with -t.
+		parallel_enabled = false;
+#  endif
+	}
+	interpreter_main_loop_instrumented();
+#else
+	if (!interpreter_need_instrumented())
+		interpreter_main_loop_plain();
+	interpreter_main_loop_instrumented();
+#endif
 }
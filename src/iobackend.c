@@ -0,0 +1,154 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "global.h"
+#include "iobackend.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h> /* realloc, free */
+#include <string.h> /* memcpy */
+#include <unistd.h> /* read, write */
+
+static ssize_t io_fd_read(ioBackend * io, void * buf, size_t len)
+{
+	ssize_t n;
+	do {
+		n = read(io->fd, buf, len);
+	} while (n < 0 && errno == EINTR);
+	return n;
+}
+
+static bool io_fd_write(ioBackend * io, const void * buf, size_t len)
+{
+	const unsigned char * data = buf;
+	while (len > 0) {
+		ssize_t written = write(io->fd, data, len);
+		if (FUNGE_UNLIKELY(written < 0)) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += written;
+		len -= (size_t)written;
+	}
+	return true;
+}
+
+static ioBackend io_stdin = {
+	.read = &io_fd_read,
+	.write = &io_fd_write,
+	.flush = NULL,
+	.fd = 0
+};
+
+static ioBackend io_stdout = {
+	.read = &io_fd_read,
+	.write = &io_fd_write,
+	.flush = NULL,
+	.fd = 1
+};
+
+ioBackend * io_input = &io_stdin;
+ioBackend * io_output = &io_stdout;
+
+void io_fd_init(ioBackend * io, int fd)
+{
+	assert(io != NULL);
+	io->read = &io_fd_read;
+	io->write = &io_fd_write;
+	io->flush = NULL;
+	io->fd = fd;
+}
+
+
+static ssize_t io_memory_read(ioBackend * io, void * buf, size_t len)
+{
+	ioMemoryBackend * mem = (ioMemoryBackend*)io;
+	size_t left = mem->input_len - mem->input_pos;
+	if (len > left)
+		len = left;
+	if (len > 0)
+		memcpy(buf, mem->input + mem->input_pos, len);
+	mem->input_pos += len;
+	return (ssize_t)len;
+}
+
+static bool io_memory_write(ioBackend * io, const void * buf, size_t len)
+{
+	ioMemoryBackend * mem = (ioMemoryBackend*)io;
+	// Nothing to copy, and output may still be NULL.
+	if (len == 0)
+		return true;
+	if (mem->output_len + len > mem->output_size) {
+		size_t newsize = mem->output_size ? mem->output_size * 2 : 4096;
+		unsigned char * newbuf;
+		while (newsize < mem->output_len + len)
+			newsize *= 2;
+		newbuf = realloc(mem->output, newsize);
+		if (FUNGE_UNLIKELY(!newbuf))
+			return false;
+		mem->output = newbuf;
+		mem->output_size = newsize;
+	}
+	memcpy(mem->output + mem->output_len, buf, len);
+	mem->output_len += len;
+	return true;
+}
+
+void io_memory_init(ioMemoryBackend * io, const void * input, size_t len)
+{
+	assert(io != NULL);
+	assert(input != NULL || len == 0);
+	io->io.read = &io_memory_read;
+	io->io.write = &io_memory_write;
+	io->io.flush = NULL;
+	io->io.fd = -1;
+	io->input = input;
+	io->input_len = len;
+	io->input_pos = 0;
+	io->output = NULL;
+	io->output_len = 0;
+	io->output_size = 0;
+}
+
+void io_memory_free(ioMemoryBackend * io)
+{
+	assert(io != NULL);
+	free(io->output);
+	io->output = NULL;
+	io->output_len = 0;
+	io->output_size = 0;
+}
+
+
+void io_set_input(ioBackend * io)
+{
+	assert(io != NULL);
+	io_input = io;
+}
+
+void io_set_output(ioBackend * io)
+{
+	assert(io != NULL);
+	io_output = io;
+}
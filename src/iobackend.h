@@ -0,0 +1,116 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * Backends for program visible I/O (the input and output instructions and the
+ * fingerprints reading stdin or writing stdout).
+ *
+ * By default input is read from fd 0 and output written to fd 1. Programs
+ * embedding cfunge (or test harnesses) can set other backends before calling
+ * interpreter_run(), such as a memory buffer to feed input from and capture
+ * output in, without any pipes or extra processes.
+ */
+
+#ifndef FUNGE_HAD_SRC_IOBACKEND_H
+#define FUNGE_HAD_SRC_IOBACKEND_H
+
+#include "global.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/// An I/O backend. Embed this as the first member to add state.
+typedef struct ioBackend {
+	/**
+	 * Read up to len bytes into buf.
+	 * @return Number of bytes read, 0 at end of input, -1 on error.
+	 */
+	ssize_t (*read)(struct ioBackend * io, void * buf, size_t len);
+	/**
+	 * Write all of buf.
+	 * @return False on error.
+	 */
+	bool (*write)(struct ioBackend * io, const void * buf, size_t len);
+	/**
+	 * Push written data on to its final destination, may be NULL.
+	 * @return False on error.
+	 */
+	bool (*flush)(struct ioBackend * io);
+	/// File descriptor, or -1 if not backed by one. Used to check for
+	/// terminals and to mmap() regular files.
+	int fd;
+} ioBackend;
+
+/// Backend reading from and writing to memory buffers.
+typedef struct ioMemoryBackend {
+	ioBackend             io;
+	const unsigned char * input;       ///< Data to return from read.
+	size_t                input_len;   ///< Length of input.
+	size_t                input_pos;   ///< How much of input was read.
+	unsigned char       * output;      ///< Everything written, malloc()ed.
+	size_t                output_len;  ///< Length of output.
+	size_t                output_size; ///< Allocated size of output.
+} ioMemoryBackend;
+
+/// Backend used for input, defaults to fd 0.
+extern ioBackend * io_input;
+/// Backend used for output, defaults to fd 1.
+extern ioBackend * io_output;
+
+/**
+ * Set up a backend using a file descriptor.
+ */
+FUNGE_ATTR_NONNULL
+void io_fd_init(ioBackend * io, int fd);
+
+/**
+ * Set up a memory backend.
+ * @param io Backend to set up.
+ * @param input Data to read, must be valid as long as the backend is used.
+ *              May be NULL if len is 0.
+ * @param len Length of input.
+ */
+FUNGE_ATTR((nonnull(1)))
+void io_memory_init(ioMemoryBackend * io, const void * input, size_t len);
+
+/**
+ * Free the captured output of a memory backend.
+ */
+FUNGE_ATTR_NONNULL
+void io_memory_free(ioMemoryBackend * io);
+
+/**
+ * Use a different backend for input. Must be called before any input is read.
+ */
+FUNGE_ATTR_NONNULL
+void io_set_input(ioBackend * io);
+
+/**
+ * Use a different backend for output. Must be called before any output is
+ * written.
+ */
+FUNGE_ATTR_NONNULL
+void io_set_output(ioBackend * io);
+
+#endif
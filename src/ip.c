@@ -30,8 +30,11 @@
 
 #include "diagnostic.h"
 #include "interpreter.h"
+#include "prng.h"
+#include "probes.h"
 #include "settings.h"
 #include "stack.h"
+#include "stats.h"
 #include "vector.h"
 
 #include "fingerprints/manager.h"
@@ -71,6 +74,16 @@ static inline bool ip_create_in_place(instructionPointer *me)
 		memset(me->fingerOpcodes, 0, sizeof(fungeOpcodeStack) * FINGEROPCODECOUNT);
 	}
 	me->fingerHRTItimestamp  = NULL;
+	me->fingerSUBRframes     = NULL;
+	me->fingerSUBRdepth      = 0;
+	me->fingerSUBRframesSize = 0;
+	prng_new_stream(&me->prng);
+#ifdef CONCURRENT_FUNGE
+	me->waitFd               = -1;
+	me->waitEvents           = 0;
+#endif
+	STATS_INC(ips_created);
+	STATS_MAX(ips_peak, 1);
 	return true;
 }
 
@@ -108,6 +121,19 @@ static inline bool ip_duplicate_in_place(const instructionPointer * restrict old
 		manager_duplicate(old, new);
 	}
 	new->fingerHRTItimestamp  = NULL;
+	prng_new_stream(&new->prng);
+	if (old->fingerSUBRframes) {
+		new->fingerSUBRframes = malloc(old->fingerSUBRframesSize * sizeof(funge_vector));
+		if (FUNGE_LIKELY(new->fingerSUBRframes)) {
+			memcpy(new->fingerSUBRframes, old->fingerSUBRframes,
+			       old->fingerSUBRframesSize * sizeof(funge_vector));
+		} else {
+			// Only used for profiling, not worth failing the split over.
+			new->fingerSUBRdepth      = 0;
+			new->fingerSUBRframesSize = 0;
+		}
+	}
+	STATS_INC(ips_created);
 	return true;
 }
 #endif
@@ -129,6 +155,8 @@ FUNGE_ATTR_FAST static inline void ip_free_resources(instructionPointer * ip)
 		free(ip->fingerHRTItimestamp);
 		ip->fingerHRTItimestamp = NULL;
 	}
+	free(ip->fingerSUBRframes);
+	ip->fingerSUBRframes = NULL;
 #  ifdef LARGE_IPLIST
 	cf_mempool_ip_free(ip);
 #  endif
@@ -287,12 +315,15 @@ FUNGE_ATTR_FAST ssize_t iplist_duplicate_ip(ipList** me, size_t index)
 	ip_reverse(list->ips[index]);
 	ip_forward(list->ips[index]);
 	list->ips[index]->ID = ++list->highestID;
+	FUNGE_PROBE2(ip_split, list->ips[index - 1]->ID, list->ips[index]->ID);
 #else
 	ip_reverse(&list->ips[index]);
 	ip_forward(&list->ips[index]);
 	list->ips[index].ID = ++list->highestID;
+	FUNGE_PROBE2(ip_split, list->ips[index - 1].ID, list->ips[index].ID);
 #endif
 	list->top++;
+	STATS_MAX(ips_peak, list->top + 1);
 	return index - 1;
 }
 
@@ -317,8 +348,10 @@ FUNGE_ATTR_FAST ssize_t iplist_terminate_ip(ipList** me, size_t index)
 	 *
 	 */
 #ifdef LARGE_IPLIST
+	FUNGE_PROBE1(ip_terminate, list->ips[index]->ID);
 	ip_free_resources(list->ips[index]);
 #else
+	FUNGE_PROBE1(ip_terminate, list->ips[index].ID);
 	ip_free_resources(&list->ips[index]);
 #endif
 	// Do we need to move downwards?
@@ -340,6 +373,7 @@ FUNGE_ATTR_FAST ssize_t iplist_terminate_ip(ipList** me, size_t index)
 	list->ips[list->top].stack = NULL;
 #endif
 	list->top--;
+	STATS_INC(ips_terminated);
 	// TODO: Shrink if difference is large
 #if 0
 	if ((list->size - ALLOCCHUNKSIZE) > list->top) {
@@ -33,6 +33,7 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+#include "prng.h"
 #include "stack.h"
 #include "vector.h"
 #include "funge-space/funge-space.h"
@@ -69,6 +70,14 @@ typedef struct s_instructionPointer {
 	fungeOpcodeStack   fingerOpcodes[FINGEROPCODECOUNT]; ///< Array of fingerprint opcodes.
 	void             * fingerHRTItimestamp;  ///< Data for fingerprint HRTI.
 	                                         ///  We don't know what type here.
+	funge_vector     * fingerSUBRframes;     ///< Entry points of active SUBR calls, only tracked for -p.
+	size_t             fingerSUBRdepth;      ///< Number of active SUBR calls, only tracked for -p.
+	size_t             fingerSUBRframesSize; ///< Allocated size of fingerSUBRframes.
+	prngState          prng;                 ///< Random numbers for ? and fingerprints.
+#ifdef CONCURRENT_FUNGE
+	int                waitFd;               ///< If not -1 the IP is parked until this fd is ready (see reactor.h).
+	short              waitEvents;           ///< The poll() events waitFd is waited for.
+#endif
 } instructionPointer;
 #define CF_INSTRUCTIONPOINTER_DEFINED
 
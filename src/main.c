@@ -27,7 +27,7 @@
 #include "main.h"
 
 #include <stdio.h>  /* fprintf, puts */
-#include <stdlib.h> /* exit */
+#include <stdlib.h> /* exit, strtoul */
 #include <signal.h> /* signal */
 #include <string.h> /* strncmp */
 #include <unistd.h> /* getopt */
@@ -47,9 +47,6 @@ int fungeargc = 0;
 
 // Exclude some code if we are building in IFFI.
 #ifndef CFUN_IS_IFFI
-// Use a larger buffer for stdout in fully buffered mode.
-static char cfun_iobuf[BUFSIZ * 4];
-
 // These are NOT worth inlineing, even though only called once.
 FUNGE_ATTR_NOINLINE FUNGE_ATTR_COLD FUNGE_ATTR_NORET
 static void print_features(void)
@@ -61,10 +58,28 @@ static void print_features(void)
 	     " - Concurrency using t instruction is disabled.\n"
 #endif
 
+#ifdef ASYNC_OUTPUT
+	     " + Asynchronous output using -A option is enabled.\n"
+#else
+	     " - Asynchronous output using -A option is disabled.\n"
+#endif
+
+#ifdef PARALLEL_FUNGE
+	     " + Parallel execution of concurrent IPs using -P option is enabled.\n"
+#elif defined(CONCURRENT_FUNGE)
+	     " - Parallel execution of concurrent IPs using -P option is disabled.\n"
+#endif
+
+#ifdef ENABLE_STATS
+	     " + Runtime statistics using -x option are enabled.\n"
+#else
+	     " - Runtime statistics using -x option are disabled.\n"
+#endif
+
 #ifndef DISABLE_TRACE
-	     " + Tracing using -t <level> option is enabled.\n"
+	     " + Tracing using -t <level> and -T <file> options is enabled.\n"
 #else
-	     " - Tracing using -t <level> option is disabled.\n"
+	     " - Tracing using -t <level> and -T <file> options is disabled.\n"
 #endif
 
 #ifdef CFUN_EXACT_BOUNDS
@@ -115,19 +130,57 @@ static void print_help(void)
 {
 	puts("Usage: cfunge [OPTIONS] [FILE] [PROGRAM OPTIONS]\n"
 	     "A fast Befunge interpreter in C\n\n"
-	     " -b           Use fully buffered output (default is system default for stdout).\n"
+#ifdef ASYNC_OUTPUT
+	     " -A           Write output from a separate thread, so the program only waits\n"
+	     "              for a slow reader when a lot of output is pending.\n"
+#endif
+	     " -B size      Use an output buffer of this many bytes (implies -b).\n"
+	     " -b           Use fully buffered output (default is line buffered if stdout is\n"
+	     "              a terminal).\n"
+	     " -C           Start one shell for = and one perl process for the PERL\n"
+	     "              fingerprint and reuse them, instead of starting new ones for\n"
+	     "              each call.\n"
 	     " -E           Show non-fatal error messages, fatal ones are always shown.\n"
 	     " -F           Disable all fingerprints.\n"
 	     " -f           Show list of features and fingerprints supported in this binary.\n"
+	     " -G seed      Seed the random number generator, so ? and other random\n"
+	     "              instructions give the same results in every run.\n"
+	     " -H prefix    Count how often each cell is executed, read with g and written\n"
+	     "              with p. Written to prefix.csv and prefix.ppm at exit.\n"
 	     " -h           Show this help and exit.\n"
+	     " -K records   With -T, only keep the last records in memory. The file is\n"
+	     "              written at exit, on SIGUSR2 and if cfunge crashes.\n"
+	     " -I bytes     Cache files loaded with i, using at most this much memory\n"
+	     "              (default 16 MiB, 0 disables). Prints cache statistics at exit.\n"
+#ifdef PARALLEL_FUNGE
+	     " -P threads   Execute concurrent IPs using this many threads (output is the\n"
+	     "              same as without this option).\n"
+#endif
+#ifdef CONCURRENT_FUNGE
+	     " -Q ticks     Let each IP run up to this many ticks before switching to the\n"
+	     "              next IP. Breaks programs depending on IPs running in lock-step.\n"
+#endif
+	     " -p file      Sample what the IPs execute about once per millisecond of CPU\n"
+	     "              time and write the result to file at exit, as folded stacks\n"
+	     "              for flame graph tools.\n"
+	     " -R file      Replay random numbers, times and input recorded with -r.\n"
+	     " -r file      Record random numbers, times and input to file, so the run\n"
+	     "              can be repeated exactly with -R.\n"
 	     " -S           Enable sandbox mode (see README for details).\n"
 	     " -s standard  Use the given standard (one of 93, 98 [default] and 109).\n"
-	     " -t level     Use given trace level. Default 0.\n"
+	     " -T file      Write a binary trace of every instruction executed to file,\n"
+	     "              see tools/trace-decode.py.\n"
+	     " -t level     Use given trace level. Default 0. Sending SIGUSR2 to a program\n"
+	     "              running without -t, -T, -H, -p, -r, -R or -x starts tracing at\n"
+	     "              level 4.\n"
 	     " -V           Show version and copyright info and exit.\n"
 	     " -v           Show version and build info and exit.\n"
 	     " -W           Show warnings."
+#ifdef ENABLE_STATS
+	     "\n -x           Print runtime statistics to stderr at exit and on SIGUSR1."
+#endif
 #ifdef DISABLE_TRACE
-	     "\nNote that someone disabled trace in this binary, so -t will have no effect."
+	     "\nNote that someone disabled trace in this binary, so -t and -T will have no effect."
 #endif
 	    );
 	exit(EXIT_SUCCESS);
@@ -142,6 +195,21 @@ static void print_build_info(void)
 #else
 	       "-con "
 #endif
+#ifdef PARALLEL_FUNGE
+	       "+parallel "
+#endif
+#ifdef ASYNC_OUTPUT
+	       "+async-output "
+#endif
+#ifdef SEGMENTED_STACKS
+	       "+segmented-stacks "
+#endif
+#ifdef ENABLE_STATS
+	       "+stats "
+#endif
+#ifdef ENABLE_USDT
+	       "+usdt "
+#endif
 #ifndef DISABLE_TRACE
 	       "+trace "
 #else
@@ -233,10 +301,27 @@ int main(int argc, char *argv[])
 	// We detect socket issues in other ways.
 	signal(SIGPIPE, SIG_IGN);
 
-	while ((opt = getopt(argc, argv, "+bEFfhSs:t:VvW")) != -1) {
+	while ((opt = getopt(argc, argv, "+AB:bCEFfG:H:hI:K:P:p:Q:R:r:Ss:T:t:VvWx")) != -1) {
 		switch (opt) {
+#ifdef ASYNC_OUTPUT
+			case 'A':
+				setting_output_async = true;
+				break;
+#endif
+			case 'B': {
+				char *end;
+				unsigned long size = strtoul(optarg, &end, 10);
+				if (size < 1 || *end != '\0') {
+					diag_fatal_format("%s is not a valid buffer size for -B.\n", optarg);
+				}
+				setting_output_buffer_size = (size_t)size;
+				break;
+			}
 			case 'b':
-				setvbuf(stdout, cfun_iobuf, _IOFBF, sizeof(cfun_iobuf));
+				setting_output_full_buffer = true;
+				break;
+			case 'C':
+				setting_persistent_coprocess = true;
 				break;
 			case 'E':
 				setting_enable_errors = true;
@@ -247,9 +332,70 @@ int main(int argc, char *argv[])
 			case 'f':
 				print_features();
 				break;
+			case 'G': {
+				char *end;
+				unsigned long long seed = strtoull(optarg, &end, 0);
+				if (*end != '\0' || end == optarg) {
+					diag_fatal_format("%s is not a valid seed for -G.\n", optarg);
+				}
+				setting_prng_seed = (uint64_t)seed;
+				setting_prng_seeded = true;
+				break;
+			}
+			case 'H':
+				setting_heatmap_prefix = optarg;
+				break;
 			case 'h':
 				print_help();
 				break;
+			case 'K': {
+				char *end;
+				unsigned long records = strtoul(optarg, &end, 10);
+				if (*end != '\0' || records == 0) {
+					diag_fatal_format("%s is not a valid record count for -K.\n", optarg);
+				}
+				setting_trace_ring = (size_t)records;
+				break;
+			}
+			case 'I': {
+				char *end;
+				unsigned long size = strtoul(optarg, &end, 10);
+				if (*end != '\0') {
+					diag_fatal_format("%s is not a valid cache size for -I.\n", optarg);
+				}
+				setting_file_cache_size = (size_t)size;
+				setting_file_cache_stats = true;
+				break;
+			}
+#ifdef PARALLEL_FUNGE
+			case 'P': {
+				int threads = atoi(optarg);
+				if (threads < 1 || threads > 1024) {
+					diag_fatal_format("%s is not a valid thread count for -P.\n", optarg);
+				}
+				setting_parallel_threads = (unsigned int)threads;
+				break;
+			}
+#endif
+#ifdef CONCURRENT_FUNGE
+			case 'Q': {
+				int quantum = atoi(optarg);
+				if (quantum < 1) {
+					diag_fatal_format("%s is not a valid quantum for -Q.\n", optarg);
+				}
+				setting_quantum = (unsigned int)quantum;
+				break;
+			}
+#endif
+			case 'p':
+				setting_profile_file = optarg;
+				break;
+			case 'R':
+				setting_replay_file = optarg;
+				break;
+			case 'r':
+				setting_record_file = optarg;
+				break;
 			case 'S':
 				setting_enable_sandbox = true;
 				break;
@@ -264,6 +410,9 @@ int main(int argc, char *argv[])
 					diag_fatal_format("%s is not valid for -s.\n", optarg);
 				}
 				break;
+			case 'T':
+				setting_trace_file = optarg;
+				break;
 			case 't':
 				setting_trace_level = (uint_fast16_t)atoi(optarg);
 				break;
@@ -276,11 +425,19 @@ int main(int argc, char *argv[])
 			case 'W':
 				setting_enable_warnings = true;
 				break;
+#ifdef ENABLE_STATS
+			case 'x':
+				setting_stats = true;
+				break;
+#endif
 			default:
 				fprintf(stderr, "For help see: %s -h\n", argv[0]);
 				return EXIT_FAILURE;
 		}
 	}
+	if (FUNGE_UNLIKELY(setting_record_file && setting_replay_file)) {
+		diag_fatal("-r and -R can't be used together.");
+	}
 	if (FUNGE_UNLIKELY(optind >= argc)) {
 		diag_fatal("No file provided.");
 	} else {
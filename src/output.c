@@ -0,0 +1,365 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "global.h"
+#include "output.h"
+#include "diagnostic.h"
+#include "iobackend.h"
+#include "settings.h"
+
+#include <stdarg.h>
+#include <stdio.h>  /* fflush, vsnprintf */
+#include <stdlib.h> /* atexit, malloc */
+#include <string.h> /* memcpy */
+#include <unistd.h> /* isatty */
+
+#ifdef ASYNC_OUTPUT
+#  include <pthread.h>
+#endif
+
+// Used unless -B asks for something larger.
+static unsigned char output_default_buf[OUTPUT_DEFAULT_SIZE];
+
+outputBuffer output_buffer = {
+	.buf = output_default_buf,
+	.size = sizeof(output_default_buf),
+	.len = 0,
+	.line_buffered = false
+};
+
+/// Two digits at a time, used by output_cell().
+static const char output_digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324"
+	"25262728293031323334353637383940414243444546474849"
+	"50515253545556575859606162636465666768697071727374"
+	"75767778798081828384858687888990919293949596979899";
+
+#ifdef ASYNC_OUTPUT
+/*
+ * Asynchronous mode (-A):
+ * The interpreter thread is the only producer and the writer thread the only
+ * consumer of the ring, so head and tail only need atomic loads and stores.
+ * The mutex and condition variables are only used to sleep when the ring is
+ * empty (writer) or full (interpreter), the sleeping flags tell the other side
+ * that it needs to signal.
+ */
+static struct {
+	unsigned char * data;
+	size_t          mask;             ///< Size of data - 1, size is a power of 2.
+	size_t          head;             ///< Written by interpreter only.
+	size_t          tail;             ///< Written by writer thread only.
+	int             error;            ///< Set by writer thread if a write failed.
+	int             writer_sleeping;
+	int             producer_waiting;
+	pthread_mutex_t lock;
+	pthread_cond_t  wake_writer;
+	pthread_cond_t  wake_producer;
+} output_ring = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake_writer = PTHREAD_COND_INITIALIZER,
+	.wake_producer = PTHREAD_COND_INITIALIZER
+};
+
+static bool output_async = false;
+
+#define RING_LOAD(m_var)          __atomic_load_n(&output_ring.m_var, __ATOMIC_SEQ_CST)
+#define RING_STORE(m_var, m_val)  __atomic_store_n(&output_ring.m_var, (m_val), __ATOMIC_SEQ_CST)
+
+static void * output_writer_main(FUNGE_ATTR_UNUSED void *arg)
+{
+	size_t tail = 0;
+
+	while (true) {
+		size_t head = RING_LOAD(head);
+		size_t offset, len;
+
+		if (head == tail) {
+			pthread_mutex_lock(&output_ring.lock);
+			RING_STORE(writer_sleeping, 1);
+			// Recheck now that the producer is guaranteed to see the flag.
+			if (RING_LOAD(head) == tail)
+				pthread_cond_wait(&output_ring.wake_writer, &output_ring.lock);
+			RING_STORE(writer_sleeping, 0);
+			pthread_mutex_unlock(&output_ring.lock);
+			continue;
+		}
+		offset = tail & output_ring.mask;
+		len = head - tail;
+		if (len > output_ring.mask + 1 - offset)
+			len = output_ring.mask + 1 - offset;
+		// Keep draining after an error, so the producer never blocks forever.
+		if (FUNGE_UNLIKELY(!io_output->write(io_output, output_ring.data + offset, len)))
+			RING_STORE(error, 1);
+		tail += len;
+		RING_STORE(tail, tail);
+		if (RING_LOAD(producer_waiting)) {
+			pthread_mutex_lock(&output_ring.lock);
+			pthread_cond_signal(&output_ring.wake_producer);
+			pthread_mutex_unlock(&output_ring.lock);
+		}
+	}
+	// Never reached.
+	return NULL;
+}
+
+/// Sleep until the writer thread has moved tail away from old_tail.
+static void output_ring_wait_for_writer(size_t old_tail)
+{
+	pthread_mutex_lock(&output_ring.lock);
+	RING_STORE(producer_waiting, 1);
+	if (RING_LOAD(tail) == old_tail)
+		pthread_cond_wait(&output_ring.wake_producer, &output_ring.lock);
+	RING_STORE(producer_waiting, 0);
+	pthread_mutex_unlock(&output_ring.lock);
+}
+
+/// Report (and clear) any error the writer thread ran into.
+static inline bool output_ring_check_error(void)
+{
+	return __atomic_exchange_n(&output_ring.error, 0, __ATOMIC_SEQ_CST) == 0;
+}
+
+/// Copy data into the ring, only blocking if it is full.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static bool output_ring_push(const unsigned char * restrict data, size_t len)
+{
+	size_t head = output_ring.head;
+
+	while (len > 0) {
+		size_t tail = RING_LOAD(tail);
+		size_t space = output_ring.mask + 1 - (head - tail);
+		size_t offset = head & output_ring.mask;
+		size_t n = len;
+
+		if (space == 0) {
+			output_ring_wait_for_writer(tail);
+			continue;
+		}
+		if (n > space)
+			n = space;
+		if (n > output_ring.mask + 1 - offset)
+			n = output_ring.mask + 1 - offset;
+		memcpy(output_ring.data + offset, data, n);
+		data += n;
+		len -= n;
+		head += n;
+		RING_STORE(head, head);
+		if (RING_LOAD(writer_sleeping)) {
+			pthread_mutex_lock(&output_ring.lock);
+			pthread_cond_signal(&output_ring.wake_writer);
+			pthread_mutex_unlock(&output_ring.lock);
+		}
+	}
+	return output_ring_check_error();
+}
+
+/// Block until the writer thread has written everything in the ring.
+static bool output_ring_drain(void)
+{
+	size_t tail;
+	while ((tail = RING_LOAD(tail)) != output_ring.head)
+		output_ring_wait_for_writer(tail);
+	return output_ring_check_error();
+}
+
+/// Allocate the ring and start the writer thread.
+static bool output_ring_setup(void)
+{
+	pthread_t thread;
+
+	output_ring.data = malloc(OUTPUT_RING_SIZE);
+	if (FUNGE_UNLIKELY(!output_ring.data))
+		return false;
+	output_ring.mask = OUTPUT_RING_SIZE - 1;
+	if (FUNGE_UNLIKELY(pthread_create(&thread, NULL, &output_writer_main, NULL) != 0)) {
+		free(output_ring.data);
+		output_ring.data = NULL;
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+#endif /* ASYNC_OUTPUT */
+
+/// Hand data over for writing, to the writer thread if we have one.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline bool output_send(const unsigned char * restrict data, size_t len)
+{
+#ifdef ASYNC_OUTPUT
+	if (output_async)
+		return output_ring_push(data, len);
+#endif
+	return io_output->write(io_output, data, len);
+}
+
+/// Send what is in the buffer, without waiting for the writer thread.
+FUNGE_ATTR_FAST
+static bool output_push(void)
+{
+	size_t len = output_buffer.len;
+
+	// Anything stdio has buffered was written before what we have.
+	fflush(stdout);
+	output_buffer.len = 0;
+	return output_send(output_buffer.buf, len);
+}
+
+FUNGE_ATTR_FAST
+bool output_flush(void)
+{
+	bool retval = output_push();
+#ifdef ASYNC_OUTPUT
+	if (output_async)
+		retval = output_ring_drain() && retval;
+#endif
+	if (io_output->flush)
+		retval = io_output->flush(io_output) && retval;
+	return retval;
+}
+
+FUNGE_ATTR_FAST
+bool output_pending(void)
+{
+	if (output_buffer.len != 0)
+		return true;
+#ifdef ASYNC_OUTPUT
+	if (output_async && RING_LOAD(tail) != output_ring.head)
+		return true;
+#endif
+	return false;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+bool output_putchar_slow(unsigned char c)
+{
+	if (output_buffer.len >= output_buffer.size && !output_push())
+		return false;
+	output_buffer.buf[output_buffer.len++] = c;
+	if (output_buffer.line_buffered && c == '\n')
+		return output_push();
+	return true;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+bool output_write(const void * restrict data, size_t len)
+{
+	if (FUNGE_UNLIKELY(output_buffer.len + len > output_buffer.size)) {
+		if (!output_push())
+			return false;
+		// Too large to be worth copying.
+		if (len > output_buffer.size)
+			return output_send(data, len);
+	}
+	memcpy(output_buffer.buf + output_buffer.len, data, len);
+	output_buffer.len += len;
+	if (output_buffer.line_buffered && memchr(data, '\n', len))
+		return output_push();
+	return true;
+}
+
+static void output_atexit(void)
+{
+	(void)output_flush();
+}
+
+void output_setup(void)
+{
+	if (setting_output_buffer_size > sizeof(output_default_buf)) {
+		unsigned char *buf = malloc(setting_output_buffer_size);
+		if (buf) {
+			output_buffer.buf = buf;
+			output_buffer.size = setting_output_buffer_size;
+		}
+		// Otherwise just keep using the default one.
+	} else if (setting_output_buffer_size != 0) {
+		output_buffer.size = setting_output_buffer_size;
+	}
+	// Same default as stdio, but an explicit size or -b means the user wants
+	// full buffering.
+	output_buffer.line_buffered = !setting_output_full_buffer
+	                              && setting_output_buffer_size == 0
+	                              && io_output->fd >= 0
+	                              && isatty(io_output->fd);
+#ifdef ASYNC_OUTPUT
+	if (setting_output_async) {
+		if (output_ring_setup())
+			output_async = true;
+		else
+			diag_warn("Failed to start output thread, writing output directly.");
+	}
+#endif
+	atexit(&output_atexit);
+}
+
+FUNGE_ATTR_FAST
+bool output_cell(funge_cell value)
+{
+	// Digits of the largest 64-bit number, a sign and the space.
+	char tmp[24];
+	char *p = tmp + sizeof(tmp);
+	funge_unsigned_cell n;
+
+	*--p = ' ';
+	// Negate as unsigned, so the most negative value works too.
+	n = (value < 0) ? -(funge_unsigned_cell)value : (funge_unsigned_cell)value;
+	while (n >= 100) {
+		const char *pair = &output_digit_pairs[(n % 100) * 2];
+		n /= 100;
+		*--p = pair[1];
+		*--p = pair[0];
+	}
+	if (n >= 10) {
+		const char *pair = &output_digit_pairs[n * 2];
+		*--p = pair[1];
+		*--p = pair[0];
+	} else {
+		*--p = (char)('0' + n);
+	}
+	if (value < 0)
+		*--p = '-';
+	return output_write(p, (size_t)(tmp + sizeof(tmp) - p));
+}
+
+FUNGE_ATTR_FORMAT(printf, 1, 2) FUNGE_ATTR_NONNULL
+bool output_printf(const char * restrict format, ...)
+{
+	// Enough for all the numbers the fingerprints print.
+	char tmp[512];
+	int len;
+	va_list ap;
+
+	va_start(ap, format);
+	len = vsnprintf(tmp, sizeof(tmp), format, ap);
+	va_end(ap);
+	if (FUNGE_UNLIKELY(len < 0))
+		return false;
+	if ((size_t)len >= sizeof(tmp)) {
+		// Rare, just hand it over to stdio after what we have.
+		if (!output_flush())
+			return false;
+		va_start(ap, format);
+		len = vprintf(format, ap);
+		va_end(ap);
+		return len >= 0 && fflush(stdout) == 0;
+	}
+	return output_write(tmp, (size_t)len);
+}
@@ -0,0 +1,129 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Buffered output to stdout for , . and fingerprints printing to stdout.
+ *
+ * The buffer is owned by the interpreter instead of stdio, so that the size and
+ * the flush policy don't depend on what stdout happens to be connected to.
+ * It is flushed at exit, before reading input, when full and (in line buffered
+ * mode) at newlines. The data is written using the io_output backend.
+ *
+ * With -A, a full buffer is instead handed to a writer thread through a ring
+ * buffer, so a slow reader on the other end of a pipe only stalls the
+ * interpreter once the ring is full. output_flush() waits for the writer
+ * thread to finish.
+ *
+ * Anything writing to stdout through stdio (such as the curses based
+ * fingerprints) must call output_flush() first to keep the output in order.
+ */
+
+#ifndef FUNGE_HAD_SRC_OUTPUT_H
+#define FUNGE_HAD_SRC_OUTPUT_H
+
+#include "global.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Size of the default buffer, used unless -B is given.
+#define OUTPUT_DEFAULT_SIZE (64 * 1024)
+
+#ifdef ASYNC_OUTPUT
+/// Size of the ring the writer thread drains in asynchronous mode (-A).
+/// Must be a power of 2.
+#  define OUTPUT_RING_SIZE (1024 * 1024)
+#endif
+
+/// State of the output buffer. Only to be used by the inline functions below.
+typedef struct outputBuffer {
+	unsigned char * buf;           ///< The buffer.
+	size_t          size;          ///< Size of buf.
+	size_t          len;           ///< Number of bytes waiting in buf.
+	bool            line_buffered; ///< Flush at each newline.
+} outputBuffer;
+
+extern outputBuffer output_buffer;
+
+/**
+ * Set up the buffer from setting_output_buffer_size and
+ * setting_output_full_buffer, and register the flush at exit.
+ */
+void output_setup(void);
+
+/**
+ * Write out everything in the buffer.
+ * @return False if the write failed. The buffered data is lost in that case.
+ */
+FUNGE_ATTR_FAST
+bool output_flush(void);
+
+/**
+ * Check if there is output that hasn't been written yet.
+ * Doesn't know about anything written to stdout using stdio.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+bool output_pending(void);
+
+/**
+ * Slow path of output_putchar(), for when the buffer is full or we are line
+ * buffered. Don't call directly.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+bool output_putchar_slow(unsigned char c);
+
+/**
+ * Write a single byte.
+ * @return False if a write failed, the IP should reflect then.
+ */
+FUNGE_ATTR_FAST
+static inline bool output_putchar(unsigned char c)
+{
+	if (FUNGE_UNLIKELY(output_buffer.len >= output_buffer.size
+	                   || output_buffer.line_buffered))
+		return output_putchar_slow(c);
+	output_buffer.buf[output_buffer.len++] = c;
+	return true;
+}
+
+/**
+ * Write a block of bytes.
+ * @return False if a write failed.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+bool output_write(const void * restrict data, size_t len);
+
+/**
+ * Write a number followed by a space, like the . instruction does.
+ * @return False if a write failed.
+ */
+FUNGE_ATTR_FAST
+bool output_cell(funge_cell value);
+
+/**
+ * printf() into the buffer.
+ * @return False if a write failed.
+ */
+FUNGE_ATTR_FORMAT(printf, 1, 2) FUNGE_ATTR_NONNULL
+bool output_printf(const char * restrict format, ...);
+
+#endif
@@ -0,0 +1,158 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "parallel.h"
+
+#ifdef PARALLEL_FUNGE
+
+#include "interpreter.h"
+#include "stack.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/*
+ * How it works:
+ * * There are (threads - 1) workers, the main thread acts as worker 0.
+ * * Each batch is split into one contiguous chunk per thread.
+ * * A generation counter protected by a mutex tells workers that a new batch
+ *   is available, and a pending counter tells the main thread when all of
+ *   them are done. The mutex also gives us the needed memory barriers.
+ */
+
+static pthread_mutex_t  parallel_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   parallel_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   parallel_done  = PTHREAD_COND_INITIALIZER;
+
+/// Total number of threads, including main thread.
+static unsigned int     parallel_threads = 1;
+/// Incremented for each new batch.
+static unsigned long    parallel_generation = 0;
+/// Number of workers that haven't finished current batch.
+static unsigned int     parallel_pending = 0;
+
+/// Current batch.
+static parallelTask   * parallel_tasks = NULL;
+/// Size of current batch.
+static size_t           parallel_count = 0;
+
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void run_task(parallelTask * restrict task)
+{
+	instructionPointer * restrict ip = task->ip;
+
+	if (ip->mode == ipmCODE && task->opcode == 'p') {
+		// Buffer the write, the main loop commits it in IP order.
+		funge_vector pos = stack_pop_vector(ip->stack);
+		task->write_value = stack_pop(ip->stack);
+		task->write_pos.x = pos.x + ip->storageOffset.x;
+		task->write_pos.y = pos.y + ip->storageOffset.y;
+		task->has_write = true;
+	} else {
+		// The instructions we get never use or change the thread index.
+		ssize_t unused = 0;
+		task->has_write = false;
+		(void)execute_instruction(task->opcode, ip, &unused);
+	}
+}
+
+FUNGE_ATTR_FAST
+static void run_chunk(unsigned int part)
+{
+	size_t per_thread = (parallel_count + parallel_threads - 1) / parallel_threads;
+	size_t begin = part * per_thread;
+	size_t end = begin + per_thread;
+
+	if (end > parallel_count)
+		end = parallel_count;
+	for (size_t i = begin; i < end; i++)
+		run_task(&parallel_tasks[i]);
+}
+
+static void * worker_main(void *arg)
+{
+	unsigned int part = (unsigned int)(uintptr_t)arg;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&parallel_lock);
+	while (true) {
+		while (parallel_generation == seen)
+			pthread_cond_wait(&parallel_start, &parallel_lock);
+		seen = parallel_generation;
+		pthread_mutex_unlock(&parallel_lock);
+
+		run_chunk(part);
+
+		pthread_mutex_lock(&parallel_lock);
+		if (--parallel_pending == 0)
+			pthread_cond_signal(&parallel_done);
+	}
+	// Never reached.
+	return NULL;
+}
+
+bool parallel_setup(unsigned int threads)
+{
+	assert(threads > 1);
+
+	for (unsigned int i = 1; i < threads; i++) {
+		pthread_t thread;
+		if (FUNGE_UNLIKELY(pthread_create(&thread, NULL, &worker_main, (void*)(uintptr_t)i) != 0))
+			return false;
+		pthread_detach(thread);
+		// Only count the ones that actually started, so we never wait for a
+		// worker that doesn't exist.
+		parallel_threads = i + 1;
+	}
+	return true;
+}
+
+FUNGE_ATTR_FAST
+void parallel_execute(parallelTask * restrict tasks, size_t count)
+{
+	assert(tasks != NULL);
+
+	if (parallel_threads == 1) {
+		for (size_t i = 0; i < count; i++)
+			run_task(&tasks[i]);
+		return;
+	}
+
+	pthread_mutex_lock(&parallel_lock);
+	parallel_tasks = tasks;
+	parallel_count = count;
+	parallel_pending = parallel_threads - 1;
+	parallel_generation++;
+	pthread_cond_broadcast(&parallel_start);
+	pthread_mutex_unlock(&parallel_lock);
+
+	run_chunk(0);
+
+	pthread_mutex_lock(&parallel_lock);
+	while (parallel_pending != 0)
+		pthread_cond_wait(&parallel_done, &parallel_lock);
+	pthread_mutex_unlock(&parallel_lock);
+}
+
+#endif /* PARALLEL_FUNGE */
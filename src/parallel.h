@@ -0,0 +1,75 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Worker thread pool for the optional parallel scheduler (-P option).
+ *
+ * The main loop collects runs of consecutive IPs that are about to execute
+ * instructions only touching their own stacks (plus g/p), and hands them to
+ * parallel_execute(). Funge-Space writes done by p are not applied by the
+ * workers, they are returned in the task so the main loop can commit them in
+ * IP order. The main loop is responsible for making sure that no IP in a batch
+ * reads a cell written by an earlier IP in the same batch.
+ */
+
+#ifndef FUNGE_HAD_SRC_PARALLEL_H
+#define FUNGE_HAD_SRC_PARALLEL_H
+
+#include "global.h"
+
+#ifdef PARALLEL_FUNGE
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ip.h"
+#include "vector.h"
+
+/// One IP's instruction in a parallel batch.
+typedef struct parallelTask {
+	instructionPointer * ip;          ///< IP to execute the instruction for.
+	funge_cell           opcode;      ///< Instruction to execute.
+	bool                 has_write;   ///< Set by worker if opcode was p.
+	funge_cell           write_value; ///< Value p wanted to store.
+	funge_vector         write_pos;   ///< Where p wanted to store it (storage offset added).
+} parallelTask;
+
+/**
+ * Start the worker threads.
+ * @param threads Total number of threads to use, including the main thread.
+ * @return True if successful, otherwise false.
+ */
+FUNGE_ATTR_WARN_UNUSED
+bool parallel_setup(unsigned int threads);
+
+/**
+ * Execute a batch of tasks, spread over the worker threads. Returns once all
+ * tasks are done. Does not move the IPs forward.
+ * @param tasks Array of tasks.
+ * @param count Number of entries in tasks.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void parallel_execute(parallelTask * restrict tasks, size_t count);
+
+#endif /* PARALLEL_FUNGE */
+
+#endif
@@ -24,13 +24,16 @@
 #include "prng.h"
 
 #include "diagnostic.h"
+#include "replay.h"
+#include "settings.h"
+
+#include <string.h> /* memcpy, strerror */
 
 #if defined(CFUN_KLEE_TEST) || defined(AFL_FUZZ_TESTING)
 #  undef HAVE_arc4random_buf
 #endif
 
 #ifdef HAVE_arc4random_buf
-#  define HAVE_ARC4RANDOM
 #  ifndef ARC4RANDOM_IN_BSD
 #    include <stdlib.h>
 #  else
@@ -38,105 +41,156 @@
 typedef unsigned char u_char;
 #    include <bsd/stdlib.h>
 #  endif
-#endif
-
-#ifndef HAVE_ARC4RANDOM
+#else
 #  include <errno.h>
-#  include <stdlib.h>
-#  include <string.h> /* strerror */
+#  include <unistd.h> /* getpid */
 
 #  ifdef HAVE_clock_gettime
 #    include <time.h>
 #  else
 #    include <sys/time.h>
 #  endif
+#endif
 
-#  if !defined(HAVE_random) || !defined(HAVE_srandom)
-#    define random rand
-#    define srandom srand
-#  endif
+/// Where the next stream starts. Any non-zero state works until prng_init().
+static prngState prng_next_stream = { {
+	UINT64_C(0x9E3779B97F4A7C15), UINT64_C(0xBF58476D1CE4E5B9),
+	UINT64_C(0x94D049BB133111EB), UINT64_C(0x2545F4914F6CDD1D)
+} };
 
-#endif
+// xoshiro256** and its jump function, by David Blackman and Sebastiano Vigna
+// (public domain), see http://prng.di.unimi.it/
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline uint64_t prng_next(prngState * restrict state)
+{
+	uint64_t * s = state->s;
+	const uint64_t result = rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+/// Same as 2^128 calls to prng_next().
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void prng_jump(prngState * restrict state)
+{
+	static const uint64_t jump[] = {
+		UINT64_C(0x180ec6d33cfd0aba), UINT64_C(0xd5a61266f0c9392c),
+		UINT64_C(0xa9582618e03fc9aa), UINT64_C(0x39abdc4529b1661c)
+	};
+	uint64_t s[4] = { 0, 0, 0, 0 };
+
+	for (size_t i = 0; i < sizeof(jump) / sizeof(jump[0]); i++) {
+		for (int b = 0; b < 64; b++) {
+			if (jump[i] & (UINT64_C(1) << b)) {
+				s[0] ^= state->s[0];
+				s[1] ^= state->s[1];
+				s[2] ^= state->s[2];
+				s[3] ^= state->s[3];
+			}
+			(void)prng_next(state);
+		}
+	}
+	memcpy(state->s, s, sizeof(s));
+}
 
-#ifndef HAVE_ARC4RANDOM
-static void setup_libc_random(void)
+/// splitmix64, used to expand the seed into a full state.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline uint64_t splitmix64(uint64_t * restrict x)
+{
+	uint64_t z = (*x += UINT64_C(0x9E3779B97F4A7C15));
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+/// Seed used when -G isn't given.
+static uint64_t prng_default_seed(void)
 {
 #if defined(CFUN_KLEE_TEST) || defined(AFL_FUZZ_TESTING)
 	// Make klee tests deterministic.
-	srandom(4);
+	return 4;
+#elif defined(HAVE_arc4random_buf)
+	uint64_t seed;
+	arc4random_buf(&seed, sizeof(seed));
+	return seed;
 #elif defined(HAVE_clock_gettime)
 	struct timespec tv;
 	if (FUNGE_UNLIKELY(clock_gettime(CLOCK_REALTIME, &tv))) {
 		diag_fatal_format("clock_gettime() failed (needed for random seed): %s", strerror(errno));
 	}
-	// Set up randomness
-	srandom((unsigned int)tv.tv_nsec);
+	return ((uint64_t)tv.tv_sec * UINT64_C(1000000000) + (uint64_t)tv.tv_nsec)
+	       ^ ((uint64_t)getpid() << 40);
 #else
 	struct timeval tv;
 	if (FUNGE_UNLIKELY(gettimeofday(&tv, NULL))) {
 		diag_fatal_format("gettimeofday() failed (needed for random seed): %s", strerror(errno));
 	}
-	// Set up randomness
-	srandom((unsigned int)tv.tv_usec);
+	return ((uint64_t)tv.tv_sec * UINT64_C(1000000) + (uint64_t)tv.tv_usec)
+	       ^ ((uint64_t)getpid() << 40);
 #endif
 }
-#endif
 
-#ifdef HAVE_ARC4RANDOM
-// This is arc4random_uniform wholesale (BSD license),
-// but adapted to work with more than 32 bits.
-/*
- * Calculate a uniformly distributed random number less than upper_bound
- * avoiding "modulo bias".
- *
- * Uniformity is achieved by generating new random numbers until the one
- * returned is outside the range [0, 2**32 % upper_bound). This
- * guarantees the selected random number will be inside
- * [2**32 % upper_bound, 2**32) which maps back to [0, upper_bound)
- * after reduction modulo upper_bound.
- */
-FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
-static inline funge_unsigned_cell cfun_arc4random_range(funge_unsigned_cell upper_bound)
+void prng_init(void)
 {
-	funge_unsigned_cell r, min;
-
-	if (upper_bound < 2)
-		return 0;
-
-	/* 2**n % x == (2**n - x) % x */
-	min = -upper_bound % upper_bound;
-	/*
-	* This could theoretically loop forever but each retry has
-	* p > 0.5 (worst case, usually far better) of selecting a
-	* number inside the range we need, so it should rarely need
-	* to re-roll.
-	*/
-	for (;;) {
-		arc4random_buf(&r, sizeof(funge_unsigned_cell));
-		if (r >= min)
-			break;
-	}
+	uint64_t x = setting_prng_seeded ? setting_prng_seed : prng_default_seed();
 
-	return r % upper_bound;
+	for (size_t i = 0; i < 4; i++)
+		prng_next_stream.s[i] = splitmix64(&x);
 }
-#endif
 
-// Sets up random seed from time.
-void prng_init(void)
+FUNGE_ATTR_FAST
+void prng_new_stream(prngState * restrict state)
 {
-#ifdef HAVE_ARC4RANDOM
-	arc4random_stir();
-#else
-	setup_libc_random();
-#endif
+	*state = prng_next_stream;
+	prng_jump(&prng_next_stream);
 }
 
 FUNGE_ATTR_FAST
-funge_unsigned_cell prng_generate_unsigned(funge_unsigned_cell max_value)
+funge_unsigned_cell prng_generate_unsigned(prngState * restrict state,
+                                           funge_unsigned_cell max_value)
 {
-#if defined(HAVE_ARC4RANDOM)
-	return cfun_arc4random_range(max_value);
-#else
-	return random() % max_value;
+	funge_unsigned_cell result;
+
+	if (max_value < 2) {
+		result = 0;
+#ifdef USE64
+	} else if (max_value > UINT32_MAX) {
+		uint64_t r, min = -(uint64_t)max_value % max_value;
+		do {
+			r = prng_next(state);
+		} while (r < min);
+		result = r % max_value;
 #endif
+	} else {
+		// Use the top 32 bits, so both cell sizes get the same numbers.
+		uint32_t max32 = (uint32_t)max_value;
+		uint32_t r;
+		if ((max32 & (max32 - 1)) == 0) {
+			// Powers of two (like 4 for ?) only need a mask.
+			r = (uint32_t)(prng_next(state) >> 32) & (max32 - 1);
+		} else {
+			// Reject the lowest 2^32 % max32 values to avoid modulo bias.
+			// 2^32 % x == (2^32 - x) % x
+			uint32_t min = -max32 % max32;
+			do {
+				r = (uint32_t)(prng_next(state) >> 32);
+			} while (r < min);
+			r %= max32;
+		}
+		result = r;
+	}
+	return (funge_unsigned_cell)replay_value(replayRANDOM, (int64_t)result);
 }
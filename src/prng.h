@@ -22,6 +22,12 @@
 /**
  * @file
  * Random number functions for Cfunge.
+ *
+ * Each IP has its own xoshiro256** generator. The first IP starts at a state
+ * derived from the seed (-G, or a random seed), and each new IP gets the
+ * stream 2^128 numbers after the one given out before it. So a given seed
+ * gives the same numbers to the same IPs in every run, no matter in which
+ * order the IPs draw them.
  */
 
 #ifndef FUNGE_HAD_SRC_PRNG_H
@@ -29,18 +35,35 @@
 
 #include "global.h"
 
+#include <stdint.h>
+
+/// State of one random number stream.
+typedef struct prngState {
+	uint64_t s[4];
+} prngState;
+
 /**
- * Initialize the PRNG (if it needs it)
+ * Seed the generator from setting_prng_seed, or from a random seed if that
+ * wasn't set. Must be called before any IP is created.
  */
 void prng_init(void);
 
+/**
+ * Give state its own stream, independent of all others given out.
+ * @param state State to set up.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void prng_new_stream(prngState * restrict state);
+
 /**
  * Generate a random number in the range [0,max_value).
  * It has protection against modulo bias.
  *
+ * @param state Stream to draw from, normally the one of the current IP.
  * @param max_value Upper bound.
  */
-FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
-funge_unsigned_cell prng_generate_unsigned(funge_unsigned_cell max_value);
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+funge_unsigned_cell prng_generate_unsigned(prngState * restrict state,
+                                           funge_unsigned_cell max_value);
 
 #endif
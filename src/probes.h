@@ -0,0 +1,63 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * USDT (user level statically defined tracing) probes.
+ *
+ * With ENABLE_USDT and sys/sdt.h available each FUNGE_PROBE* is a single
+ * NOP in the code plus a note in the binary describing where the arguments
+ * are, so perf, bpftrace and SystemTap can attach to a running cfunge:
+ * @code
+ * bpftrace -e 'usdt:./cfunge:cfunge:ip_split { printf("%d -> %d\n", arg0, arg1); }'
+ * @endcode
+ * Otherwise they expand to nothing.
+ *
+ * Probes (provider cfunge):
+ * - instruction(id, x, y, opcode): main loop, before executing.
+ * - fspace_set(x, y, value): p and other writes through fungespace_set().
+ * - fspace_hash_insert(x, y), fspace_hash_remove(x, y): cells outside the
+ *   static area being added to or removed from the hash table.
+ * - bounds_minimize(minx, miny, maxx, maxy): after recalculating bounds.
+ * - ip_split(id, newid), ip_terminate(id).
+ * - fprint_load(id, fprint, ok), fprint_unload(id, fprint, ok).
+ * - stack_grow(size, top), stack_shrink(size, top): before reallocating.
+ */
+
+#ifndef FUNGE_HAD_SRC_PROBES_H
+#define FUNGE_HAD_SRC_PROBES_H
+
+#include "global.h"
+
+#ifdef ENABLE_USDT
+#  include <sys/sdt.h>
+#  define FUNGE_PROBE1(name, a)          DTRACE_PROBE1(cfunge, name, a)
+#  define FUNGE_PROBE2(name, a, b)       DTRACE_PROBE2(cfunge, name, a, b)
+#  define FUNGE_PROBE3(name, a, b, c)    DTRACE_PROBE3(cfunge, name, a, b, c)
+#  define FUNGE_PROBE4(name, a, b, c, d) DTRACE_PROBE4(cfunge, name, a, b, c, d)
+#else
+#  define FUNGE_PROBE1(name, a)          /* NO-OP */
+#  define FUNGE_PROBE2(name, a, b)       /* NO-OP */
+#  define FUNGE_PROBE3(name, a, b, c)    /* NO-OP */
+#  define FUNGE_PROBE4(name, a, b, c, d) /* NO-OP */
+#endif
+
+#endif
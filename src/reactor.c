@@ -0,0 +1,152 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "global.h"
+#include "reactor.h"
+#include "diagnostic.h"
+#include "output.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef CONCURRENT_FUNGE
+/// Poll without blocking once per this many ticks while some IPs can run.
+#  define REACTOR_POLL_INTERVAL 64
+
+size_t reactor_parked = 0;
+
+/// Ticks since last poll.
+static unsigned int reactor_ticks = 0;
+/// Buffer for poll().
+static struct pollfd *reactor_fds = NULL;
+/// Which IP each entry in reactor_fds belongs to.
+static instructionPointer **reactor_ips = NULL;
+/// Size of the two arrays above.
+static size_t reactor_size = 0;
+
+FUNGE_ATTR_FAST bool
+reactor_wait(instructionPointer * restrict ip, int fd, short events)
+{
+	assert(ip != NULL);
+	assert(ip->waitFd == -1);
+
+	ip->waitFd = fd;
+	ip->waitEvents = events;
+	// Execute the same instruction again.
+	ip->needMove = false;
+	reactor_parked++;
+	return true;
+}
+
+/**
+ * Poll the file descriptors of parked IPs and wake up the ready ones.
+ * @param list The IP list.
+ * @param block If true wait until at least one is ready.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void reactor_poll(ipList * restrict list, bool block)
+{
+	size_t n = 0;
+	int ready;
+
+	if (FUNGE_UNLIKELY(reactor_size < reactor_parked)) {
+		size_t newsize = reactor_parked * 2;
+		struct pollfd *newfds = realloc(reactor_fds, newsize * sizeof(struct pollfd));
+		instructionPointer **newips;
+		if (FUNGE_UNLIKELY(!newfds)) {
+			DIAG_OOM("Couldn't grow poll array");
+		}
+		reactor_fds = newfds;
+		newips = realloc(reactor_ips, newsize * sizeof(instructionPointer*));
+		if (FUNGE_UNLIKELY(!newips)) {
+			DIAG_OOM("Couldn't grow poll array");
+		}
+		reactor_ips = newips;
+		reactor_size = newsize;
+	}
+
+	for (size_t i = 0; i <= list->top; i++) {
+#  ifdef LARGE_IPLIST
+		instructionPointer *ip = list->ips[i];
+#  else
+		instructionPointer *ip = &list->ips[i];
+#  endif
+		if (ip->waitFd == -1)
+			continue;
+		reactor_fds[n].fd = ip->waitFd;
+		reactor_fds[n].events = ip->waitEvents;
+		reactor_fds[n].revents = 0;
+		reactor_ips[n] = ip;
+		n++;
+	}
+	assert(n == reactor_parked);
+
+	// Nobody will see the output until we are done waiting otherwise.
+	if (block)
+		output_flush();
+	ready = poll(reactor_fds, (nfds_t)n, block ? -1 : 0);
+	if (ready <= 0)
+		return;
+	for (size_t i = 0; i < n && ready > 0; i++) {
+		// Errors and hangups wake the IP too, the retried call reports them.
+		if (reactor_fds[i].revents != 0) {
+			reactor_ips[i]->waitFd = -1;
+			reactor_parked--;
+			ready--;
+		}
+	}
+}
+
+FUNGE_ATTR_FAST void
+reactor_tick(ipList * restrict list)
+{
+	assert(list != NULL);
+
+	if (reactor_parked == list->top + 1) {
+		reactor_ticks = 0;
+		reactor_poll(list, true);
+	} else if (++reactor_ticks >= REACTOR_POLL_INTERVAL) {
+		reactor_ticks = 0;
+		reactor_poll(list, false);
+	}
+}
+
+#else /* CONCURRENT_FUNGE */
+
+FUNGE_ATTR_FAST bool
+reactor_wait(instructionPointer * restrict ip, int fd, short events)
+{
+	struct pollfd pfd;
+
+	assert(ip != NULL);
+	(void)ip;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	output_flush();
+	while (poll(&pfd, 1, -1) == -1 && errno == EINTR)
+		;
+	return false;
+}
+
+#endif /* CONCURRENT_FUNGE */
@@ -0,0 +1,71 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * Waiting for file descriptors without stalling other IPs.
+ *
+ * Fingerprints doing network IO use non-blocking sockets. When an operation
+ * would block they call reactor_wait(). In concurrent mode that parks the IP:
+ * the main loop skips it, and polls the file descriptors of all parked IPs
+ * now and then (or blocks in poll() when every IP is parked). Once the file
+ * descriptor is ready the instruction is executed again.
+ */
+
+#ifndef FUNGE_HAD_SRC_REACTOR_H
+#define FUNGE_HAD_SRC_REACTOR_H
+
+#include "global.h"
+#include "ip.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <poll.h>
+
+/**
+ * Wait for a file descriptor to become ready.
+ * @param ip The IP executing the instruction.
+ * @param fd File descriptor the instruction is waiting for.
+ * @param events POLLIN or POLLOUT.
+ * @return
+ * True if the IP was parked. The caller must then restore the stack to what
+ * it was before the instruction, which will be executed again when fd is
+ * ready. False if this call blocked until fd is ready (or failed), the caller
+ * should then retry the operation directly.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+bool reactor_wait(instructionPointer * restrict ip, int fd, short events);
+
+#ifdef CONCURRENT_FUNGE
+/// Number of parked IPs. The main loop only calls reactor_tick() if non-zero.
+extern size_t reactor_parked;
+
+/**
+ * Called by the main loop once per tick when some IPs are parked. Wakes up
+ * the IPs whose file descriptors are ready.
+ * @param list The IP list.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void reactor_tick(ipList * restrict list);
+#endif
+
+#endif
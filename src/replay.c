@@ -0,0 +1,193 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "replay.h"
+#include "diagnostic.h"
+#include "iobackend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REPLAY_HEADER "cfunge-replay 1\n"
+
+bool replay_enabled = false;
+uint64_t replay_instructions = 0;
+
+static FILE * replay_file = NULL;
+static bool   replay_recording = false;
+
+/// Backend wrapping the real input when recording, or feeding recorded
+/// blocks when replaying.
+typedef struct replayBackend {
+	ioBackend       io;
+	ioBackend     * inner;   ///< Real input, only when recording.
+	unsigned char * pending; ///< Replay: rest of the current block.
+	size_t          pending_len;
+	size_t          pending_size;
+} replayBackend;
+
+static replayBackend replay_input;
+
+static void replay_close(void)
+{
+	if (fclose(replay_file) != 0 && replay_recording)
+		diag_error_format("Failed to write record file: %s", strerror(errno));
+	replay_file = NULL;
+	replay_enabled = false;
+	free(replay_input.pending);
+}
+
+/// Read the next record header, checking it is what we expect now.
+static void replay_expect(replayKind kind)
+{
+	uint64_t count;
+	char found;
+
+	if (fscanf(replay_file, "%" SCNu64 " %c", &count, &found) != 2) {
+		diag_fatal_format("Replay file ended at instruction %" PRIu64 ", wanted '%c'.",
+		                  replay_instructions, (char)kind);
+	}
+	if (count != replay_instructions || found != (char)kind) {
+		diag_fatal_format("Replay diverged at instruction %" PRIu64 ": wanted '%c', file has '%c' at instruction %" PRIu64 ".",
+		                  replay_instructions, (char)kind, found, count);
+	}
+}
+
+int64_t replay_value_slow(replayKind kind, int64_t value)
+{
+	intmax_t recorded;
+
+	if (replay_recording) {
+		fprintf(replay_file, "%" PRIu64 " %c %" PRId64 "\n", replay_instructions, (char)kind, value);
+		return value;
+	}
+	replay_expect(kind);
+	if (fscanf(replay_file, "%jd", &recorded) != 1) {
+		diag_fatal_format("Bad value in replay file at instruction %" PRIu64 ".", replay_instructions);
+	}
+	return (int64_t)recorded;
+}
+
+static ssize_t replay_record_read(ioBackend * io, void * buf, size_t len)
+{
+	replayBackend * rb = (replayBackend*)io;
+	ssize_t n = rb->inner->read(rb->inner, buf, len);
+	const unsigned char * data = buf;
+
+	// Errors are recorded as end of input, that is what the program sees.
+	fprintf(replay_file, "%" PRIu64 " %c ", replay_instructions, (char)replayINPUT);
+	for (ssize_t i = 0; i < n; i++)
+		fprintf(replay_file, "%02x", data[i]);
+	fputc('\n', replay_file);
+	return n;
+}
+
+/// Load the next input block into pending.
+static void replay_load_block(replayBackend * rb)
+{
+	static const char hex[] = "0123456789abcdef";
+	int c;
+
+	replay_expect(replayINPUT);
+	rb->pending_len = 0;
+	c = getc(replay_file);
+	if (c == ' ')
+		c = getc(replay_file);
+	while (c != '\n' && c != EOF) {
+		const char *hi = strchr(hex, c);
+		const char *lo = strchr(hex, getc(replay_file));
+		if (!hi || !lo || !*hi || !*lo) {
+			diag_fatal_format("Bad input block in replay file at instruction %" PRIu64 ".", replay_instructions);
+		}
+		if (rb->pending_len == rb->pending_size) {
+			size_t newsize = rb->pending_size ? rb->pending_size * 2 : 4096;
+			unsigned char *newdata = realloc(rb->pending, newsize);
+			if (FUNGE_UNLIKELY(!newdata)) {
+				DIAG_OOM("Couldn't allocate replay input buffer");
+			}
+			rb->pending = newdata;
+			rb->pending_size = newsize;
+		}
+		rb->pending[rb->pending_len++] = (unsigned char)(((hi - hex) << 4) | (lo - hex));
+		c = getc(replay_file);
+	}
+}
+
+static ssize_t replay_replay_read(ioBackend * io, void * buf, size_t len)
+{
+	replayBackend * rb = (replayBackend*)io;
+
+	// The input code asks for the same sizes as when recording, but a block
+	// from a build with a different buffer size is handed out over several
+	// reads.
+	if (rb->pending_len == 0)
+		replay_load_block(rb);
+	if (len > rb->pending_len)
+		len = rb->pending_len;
+	memcpy(buf, rb->pending, len);
+	memmove(rb->pending, rb->pending + len, rb->pending_len - len);
+	rb->pending_len -= len;
+	return (ssize_t)len;
+}
+
+void replay_setup(const char * restrict filename, bool record)
+{
+	int fd;
+
+	replay_file = fopen(filename, record ? "w" : "r");
+	if (!replay_file) {
+		diag_fatal_format("Failed to open %s file \"%s\": %s",
+		                  record ? "record" : "replay", filename, strerror(errno));
+	}
+	fd = fileno(replay_file);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	replay_recording = record;
+
+	replay_input.io = *io_input;
+	replay_input.io.write = NULL;
+	replay_input.io.flush = NULL;
+	if (record) {
+		fputs(REPLAY_HEADER, replay_file);
+		replay_input.inner = io_input;
+		replay_input.io.read = &replay_record_read;
+		// Keep terminals line based, but don't let input mmap() a file
+		// behind our back.
+		if (io_input->fd >= 0 && !isatty(io_input->fd))
+			replay_input.io.fd = -1;
+	} else {
+		char header[sizeof(REPLAY_HEADER)];
+		if (!fgets(header, sizeof(header), replay_file) || strcmp(header, REPLAY_HEADER) != 0) {
+			diag_fatal_format("\"%s\" is not a cfunge replay file.", filename);
+		}
+		replay_input.inner = NULL;
+		replay_input.io.read = &replay_replay_read;
+		replay_input.io.fd = -1;
+	}
+	io_set_input(&replay_input.io);
+	replay_enabled = true;
+	atexit(&replay_close);
+}
@@ -0,0 +1,91 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Record and replay of nondeterministic input (-r and -R options).
+ *
+ * With -r every value the program can observe that may differ between runs
+ * is written to a file, together with the number of instructions executed
+ * so far: random numbers (?, TOYS U, FIXP D), the current time (y, TIME),
+ * HRTI timer values and each block read from stdin. With -R the values are
+ * taken from such a file instead, so the run repeats the recorded one
+ * exactly. A replay that asks for a different kind of value, or asks at a
+ * different instruction, stops with an error.
+ *
+ * The file is text, one value per line after a "cfunge-replay 1" header:
+ *
+ *     1234 r 3
+ *     1500 i 6869210a
+ *
+ * That is the instruction count, the kind and the value (hex bytes for input,
+ * empty at end of input).
+ */
+
+#ifndef FUNGE_HAD_SRC_REPLAY_H
+#define FUNGE_HAD_SRC_REPLAY_H
+
+#include "global.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Kind of recorded value, also used as the tag in the file.
+typedef enum replayKind {
+	replayRANDOM = 'r', ///< From the PRNG.
+	replayTIME   = 't', ///< From time().
+	replayTIMER  = 'c', ///< HRTI timer values.
+	replayINPUT  = 'i', ///< A block read from stdin.
+} replayKind;
+
+/// True if -r or -R was given.
+extern bool replay_enabled;
+/// Instructions executed so far, only counted when replay_enabled.
+extern uint64_t replay_instructions;
+
+/**
+ * Open the file and hook the input backend. Must be called before any input
+ * is read.
+ * @param filename File to record to or replay from.
+ * @param record True for -r, false for -R.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+void replay_setup(const char * restrict filename, bool record);
+
+/**
+ * Record value, or return the value recorded in its place.
+ * Use replay_value() instead.
+ */
+FUNGE_ATTR_NOINLINE
+int64_t replay_value_slow(replayKind kind, int64_t value);
+
+/// Pass a nondeterministic value through the recorder.
+#define replay_value(kind, value) \
+	(FUNGE_UNLIKELY(replay_enabled) ? replay_value_slow((kind), (value)) : (value))
+
+/// Count an instruction, used in the instrumented main loop.
+#define REPLAY_TICK() \
+	do { \
+		if (FUNGE_UNLIKELY(replay_enabled)) \
+			replay_instructions++; \
+	} while (0)
+
+#endif
@@ -0,0 +1,276 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "sampler.h"
+#include "diagnostic.h"
+#include "stack.h"
+
+#include "fingerprints/manager.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/// Sampling interval, in microseconds of CPU time.
+#define SAMPLER_INTERVAL_USEC 1000
+/// Deeper SUBR calls are summarised as a single "..." frame.
+#define SAMPLER_MAX_FRAMES 64
+/// Initial number of buckets, must be a power of two.
+#define SAMPLER_HASH_MIN 256
+
+/// One distinct stack and how many times it was seen.
+typedef struct samplerEntry {
+	struct samplerEntry * next;
+	unsigned long         count;
+	char                  key[]; ///< Folded stack, without the count.
+} samplerEntry;
+
+bool sampler_enabled = false;
+volatile sig_atomic_t sampler_pending = 0;
+
+static samplerEntry ** sampler_buckets = NULL;
+static size_t          sampler_nbuckets = 0;
+static size_t          sampler_nentries = 0;
+static char          * sampler_filename = NULL;
+
+/// FNV-1a.
+FUNGE_ATTR_PURE
+static size_t sampler_hash(const char * restrict key)
+{
+	uint32_t h = 2166136261u;
+	while (*key) {
+		h ^= (unsigned char)*key++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void sampler_grow(void)
+{
+	size_t newsize = sampler_nbuckets * 2;
+	samplerEntry ** newbuckets = calloc(newsize, sizeof(samplerEntry*));
+
+	if (!newbuckets)
+		return; // Longer chains, still works.
+	for (size_t i = 0; i < sampler_nbuckets; i++) {
+		samplerEntry * e = sampler_buckets[i];
+		while (e) {
+			samplerEntry * next = e->next;
+			size_t b = sampler_hash(e->key) & (newsize - 1);
+			e->next = newbuckets[b];
+			newbuckets[b] = e;
+			e = next;
+		}
+	}
+	free(sampler_buckets);
+	sampler_buckets = newbuckets;
+	sampler_nbuckets = newsize;
+}
+
+static void sampler_add(const char * restrict key)
+{
+	size_t b = sampler_hash(key) & (sampler_nbuckets - 1);
+	samplerEntry * e;
+	size_t len;
+
+	for (e = sampler_buckets[b]; e; e = e->next) {
+		if (strcmp(e->key, key) == 0) {
+			e->count++;
+			return;
+		}
+	}
+	len = strlen(key) + 1;
+	e = malloc(sizeof(samplerEntry) + len);
+	if (FUNGE_UNLIKELY(!e)) {
+		DIAG_OOM("Couldn't allocate profiler sample");
+	}
+	memcpy(e->key, key, len);
+	e->count = 1;
+	e->next = sampler_buckets[b];
+	sampler_buckets[b] = e;
+	if (++sampler_nentries > sampler_nbuckets)
+		sampler_grow();
+}
+
+/// Appends to buf at *len, never past size. Truncated output is still valid.
+FUNGE_ATTR_FORMAT(printf, 4, 5)
+static void sampler_append(char * restrict buf, size_t size, size_t * restrict len,
+                           const char * restrict format, ...)
+{
+	va_list ap;
+	int n;
+
+	if (*len >= size - 1)
+		return;
+	va_start(ap, format);
+	n = vsnprintf(buf + *len, size - *len, format, ap);
+	va_end(ap);
+	if (n > 0)
+		*len += ((size_t)n < size - *len) ? (size_t)n : size - *len - 1;
+}
+
+void sampler_take(const instructionPointer * restrict ip, funge_cell opcode)
+{
+	char key[4096];
+	char name[5];
+	size_t len = 0;
+	// The depth may be larger than the array if growing it failed.
+	size_t frames = ip->fingerSUBRdepth;
+
+	sampler_pending = 0;
+#ifdef CONCURRENT_FUNGE
+	sampler_append(key, sizeof(key), &len, "ip %" FUNGECELLPRI ";", ip->ID);
+#endif
+	if (frames > ip->fingerSUBRframesSize)
+		frames = ip->fingerSUBRframesSize;
+	if (frames > SAMPLER_MAX_FRAMES)
+		frames = SAMPLER_MAX_FRAMES;
+	for (size_t i = 0; i < frames; i++)
+		sampler_append(key, sizeof(key), &len, "SUBR %" FUNGECELLPRI ",%" FUNGECELLPRI ";",
+		               ip->fingerSUBRframes[i].x, ip->fingerSUBRframes[i].y);
+	if (ip->fingerSUBRdepth > frames)
+		sampler_append(key, sizeof(key), &len, "...;");
+	if (ip->stackstack->current > 0)
+		sampler_append(key, sizeof(key), &len, "ss %zu;", ip->stackstack->current + 1);
+
+	sampler_append(key, sizeof(key), &len, "%" FUNGECELLPRI ",%" FUNGECELLPRI " ",
+	               ip->position.x, ip->position.y);
+	// ; separates frames, so only use the character for safe ones.
+	if (ip->mode == ipmSTRING)
+		sampler_append(key, sizeof(key), &len, "string");
+	else if (opcode > ' ' && opcode < 127 && opcode != ';')
+		sampler_append(key, sizeof(key), &len, "'%c'", (char)opcode);
+	else
+		sampler_append(key, sizeof(key), &len, "#%" FUNGECELLPRI, opcode);
+	if (ip->mode != ipmSTRING && manager_binding_name(ip, opcode, name))
+		sampler_append(key, sizeof(key), &len, " (%s)", name);
+	sampler_append(key, sizeof(key), &len, " %" FUNGECELLPRI ",%" FUNGECELLPRI,
+	               ip->delta.x, ip->delta.y);
+	sampler_add(key);
+}
+
+void sampler_subr_call(instructionPointer * restrict ip, const funge_vector * restrict entry)
+{
+	if (ip->fingerSUBRdepth == ip->fingerSUBRframesSize) {
+		size_t newsize = ip->fingerSUBRframesSize ? ip->fingerSUBRframesSize * 2 : 8;
+		funge_vector * frames = realloc(ip->fingerSUBRframes, newsize * sizeof(funge_vector));
+		if (FUNGE_UNLIKELY(!frames)) {
+			// Just count the depth then, the frame shows up as "...".
+			ip->fingerSUBRdepth++;
+			return;
+		}
+		ip->fingerSUBRframes = frames;
+		ip->fingerSUBRframesSize = newsize;
+	}
+	ip->fingerSUBRframes[ip->fingerSUBRdepth++] = *entry;
+}
+
+void sampler_subr_return(instructionPointer * restrict ip)
+{
+	// R without C is allowed, the program may have pushed the frame itself.
+	if (ip->fingerSUBRdepth > 0)
+		ip->fingerSUBRdepth--;
+}
+
+static int sampler_compare(const void * a, const void * b)
+{
+	return strcmp((*(const samplerEntry * const *)a)->key,
+	              (*(const samplerEntry * const *)b)->key);
+}
+
+static void sampler_write(void)
+{
+	struct itimerval off;
+	samplerEntry ** sorted;
+	size_t n = 0;
+	FILE * f;
+
+	memset(&off, 0, sizeof(off));
+	setitimer(ITIMER_PROF, &off, NULL);
+
+	sorted = malloc((sampler_nentries + 1) * sizeof(samplerEntry*));
+	f = fopen(sampler_filename, "w");
+	if (!sorted || !f) {
+		fprintf(stderr, "Failed to write profile to \"%s\": %s\n",
+		        sampler_filename, strerror(errno));
+	} else {
+		for (size_t i = 0; i < sampler_nbuckets; i++)
+			for (samplerEntry * e = sampler_buckets[i]; e; e = e->next)
+				sorted[n++] = e;
+		qsort(sorted, n, sizeof(samplerEntry*), &sampler_compare);
+		for (size_t i = 0; i < n; i++)
+			fprintf(f, "%s %lu\n", sorted[i]->key, sorted[i]->count);
+	}
+	if (f && fclose(f) != 0)
+		fprintf(stderr, "Failed to write profile to \"%s\": %s\n",
+		        sampler_filename, strerror(errno));
+	free(sorted);
+	for (size_t i = 0; i < sampler_nbuckets; i++) {
+		samplerEntry * e = sampler_buckets[i];
+		while (e) {
+			samplerEntry * next = e->next;
+			free(e);
+			e = next;
+		}
+	}
+	free(sampler_buckets);
+	free(sampler_filename);
+	sampler_enabled = false;
+}
+
+static void sampler_signal(int signum)
+{
+	(void)signum;
+	sampler_pending = 1;
+}
+
+void sampler_setup(const char * restrict filename)
+{
+	struct sigaction action;
+	struct itimerval timer;
+
+	sampler_filename = strdup(filename);
+	sampler_nbuckets = SAMPLER_HASH_MIN;
+	sampler_buckets = calloc(sampler_nbuckets, sizeof(samplerEntry*));
+	if (FUNGE_UNLIKELY(!sampler_filename || !sampler_buckets)) {
+		DIAG_OOM("Couldn't set up profiler");
+	}
+	sampler_enabled = true;
+	manager_track_bindings = true;
+	atexit(&sampler_write);
+
+	action.sa_handler = &sampler_signal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGPROF, &action, NULL);
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = SAMPLER_INTERVAL_USEC;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+		DIAG_FATAL_FORMAT_LOC("Couldn't start profiling timer: %s", strerror(errno));
+	}
+}
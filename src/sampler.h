@@ -0,0 +1,88 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Statistical sampling profiler (-p option).
+ *
+ * A SIGPROF timer sets a flag about once per millisecond of CPU time. The
+ * main loop checks the flag before each instruction and records the IP that
+ * is about to execute: position, delta, opcode and for A-Z the fingerprint
+ * the opcode is bound to. Samples are aggregated and written at exit in the
+ * folded format used by flame graph tools, one line per distinct stack:
+ *
+ *     ip 0;SUBR 10,2;ss 2;5,3 '+' 1,0 123
+ *
+ * The frames are the IP ID (concurrent builds), the entry point of each
+ * active SUBR call, the stack-stack depth if above 1 and finally the cell.
+ */
+
+#ifndef FUNGE_HAD_SRC_SAMPLER_H
+#define FUNGE_HAD_SRC_SAMPLER_H
+
+#include "global.h"
+#include "ip.h"
+#include "vector.h"
+
+#include <signal.h>
+#include <stdbool.h>
+
+/// True if -p was given.
+extern bool sampler_enabled;
+/// Set by the SIGPROF handler, cleared when the sample is taken.
+extern volatile sig_atomic_t sampler_pending;
+
+/**
+ * Start the timer and register the writer to run at exit.
+ * @param filename Where to write the folded stacks.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+void sampler_setup(const char * restrict filename);
+
+/**
+ * Record a sample for ip, which is about to execute opcode.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NOINLINE FUNGE_ATTR_NONNULL
+void sampler_take(const instructionPointer * restrict ip, funge_cell opcode);
+
+/// Take a sample if the timer fired since the last one.
+#define SAMPLER_POLL(ip, opcode) \
+	do { \
+		if (FUNGE_UNLIKELY(sampler_pending)) \
+			sampler_take((ip), (opcode)); \
+	} while (0)
+
+/**
+ * Track SUBR calls, so samples can show what subroutine they are in.
+ * Only called when sampler_enabled.
+ * @param ip IP doing the call.
+ * @param entry Position called.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void sampler_subr_call(instructionPointer * restrict ip, const funge_vector * restrict entry);
+
+/**
+ * Track SUBR returns. Only called when sampler_enabled.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void sampler_subr_return(instructionPointer * restrict ip);
+
+#endif
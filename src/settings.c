@@ -22,6 +22,7 @@
 #include "global.h"
 
 #include "settings.h"
+#include "funge-space/file-cache.h"
 
 // This file is just for some global variables.
 
@@ -31,4 +32,31 @@ uint_fast16_t setting_trace_level = 0;
 bool setting_enable_warnings = false;
 bool setting_enable_errors = false;
 bool setting_disable_fingerprints = false;
+size_t setting_output_buffer_size = 0;
+bool setting_output_full_buffer = false;
+size_t setting_file_cache_size = FILECACHE_DEFAULT_SIZE;
+bool setting_file_cache_stats = false;
+bool setting_persistent_coprocess = false;
+const char * setting_heatmap_prefix = NULL;
+const char * setting_profile_file = NULL;
+uint64_t setting_prng_seed = 0;
+bool setting_prng_seeded = false;
+const char * setting_record_file = NULL;
+const char * setting_replay_file = NULL;
+const char * setting_trace_file = NULL;
+size_t setting_trace_ring = 0;
+#ifdef ENABLE_STATS
+bool setting_stats = false;
+#endif
+#ifdef ASYNC_OUTPUT
+bool setting_output_async = false;
+#endif
 bool setting_enable_sandbox = false;
+
+#ifdef CONCURRENT_FUNGE
+unsigned int setting_quantum = 0;
+#endif
+
+#ifdef PARALLEL_FUNGE
+unsigned int setting_parallel_threads = 0;
+#endif
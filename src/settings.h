@@ -33,6 +33,7 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /// What version of the Funge standard we are executing.
 /// @note
@@ -55,6 +56,52 @@ extern bool setting_enable_errors;
 /// Should fingerprints be enabled
 extern bool setting_disable_fingerprints;
 
+/// Size of output buffer. 0 = default size.
+extern size_t setting_output_buffer_size;
+/// Use full buffering for output even if stdout is a terminal.
+extern bool setting_output_full_buffer;
+/// Max memory used for caching files loaded with i. 0 = disabled.
+extern size_t setting_file_cache_size;
+/// Print file cache statistics at exit.
+extern bool setting_file_cache_stats;
+/// Keep long-running processes for = and PERL instead of starting one per call.
+extern bool setting_persistent_coprocess;
+/// Write a heatmap to this prefix + .csv/.ppm at exit. NULL = disabled.
+extern const char * setting_heatmap_prefix;
+/// Write sampled profile to this file at exit. NULL = disabled.
+extern const char * setting_profile_file;
+/// Seed for the random number generator, only used if setting_prng_seeded.
+extern uint64_t setting_prng_seed;
+/// True if -G was given.
+extern bool setting_prng_seeded;
+/// Record nondeterministic values to this file. NULL = disabled.
+extern const char * setting_record_file;
+/// Replay nondeterministic values from this file. NULL = disabled.
+extern const char * setting_replay_file;
+/// Write binary trace to this file. NULL = disabled.
+extern const char * setting_trace_file;
+/// Only keep this many trace records in memory. 0 = stream all of them.
+extern size_t setting_trace_ring;
+#ifdef ENABLE_STATS
+/// Print runtime counters at exit and on SIGUSR1.
+extern bool setting_stats;
+#endif
+#ifdef ASYNC_OUTPUT
+/// Write output from a separate thread.
+extern bool setting_output_async;
+#endif
+
+#ifdef CONCURRENT_FUNGE
+/// Max number of ticks each IP may run before switching to the next one.
+/// 0 or 1 = normal lock-step scheduling.
+extern unsigned int setting_quantum;
+#endif
+
+#ifdef PARALLEL_FUNGE
+/// Number of threads to execute concurrent IPs on. 0 or 1 = sequential.
+extern unsigned int setting_parallel_threads;
+#endif
+
 /// Sandbox, prevent bad programs affecting system.
 /// If true:
 /// - Any file, filesystem or network IO is forbidden.
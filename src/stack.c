@@ -19,21 +19,351 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#if defined(HAVE_mremap) && !defined(_GNU_SOURCE)
+// mremap() and MAP_ANONYMOUS are Linux extensions.
+#  define _GNU_SOURCE
+#endif
+
 #include "global.h"
 #include "stack.h"
 #include "vector.h"
 #include "ip.h"
 #include "settings.h"
 #include "diagnostic.h"
+#include "probes.h"
+#include "stats.h"
+
+#define CFUNGE_MEMPOOL_STACKS
+#include "../lib/mempool/cfunge_mempool.h"
 
 #include <assert.h>
 #include <string.h> /* memcpy, memset */
+#ifdef HAVE_mremap
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
-/// How many new items to allocate in one go?
-#define ALLOCSIZE_STACK 4096
+/// Smallest separate allocation, when a stack outgrows the inline storage.
+#define STACK_HEAP_MIN 256
+/// Allocations of this many bytes or more are done with mmap() (if mremap()
+/// is available), so they can grow and shrink without copying.
+#define STACK_MMAP_THRESHOLD (1024 * 1024)
+#if defined(SEGMENTED_STACKS) && !defined(STACK_SEGMENT_SIZE)
+/// Once the top segment is this large, new items go into a new segment
+/// instead of growing it.
+#  define STACK_SEGMENT_SIZE (1024 * 1024)
+#endif
 /// How many stack pointers to allocate for the stack stack in one go.
 #define ALLOCSIZE_STACKSTACK 32
 
+/// Number of items in entries.
+#ifdef SEGMENTED_STACKS
+#  define STACK_LOCAL_TOP(stack) ((stack)->top - (stack)->base)
+#else
+#  define STACK_LOCAL_TOP(stack) ((stack)->top)
+#endif
+
+/// Have the stack mempool been set up yet?
+static bool stack_pool_ready = false;
+#ifdef HAVE_mremap
+/// Page size, mmap()ed blocks are rounded up to this.
+static size_t stack_page_size = 4096;
+#endif
+
+
+/*********************
+ * Memory management *
+ *********************/
+
+/// Free a block allocated by stack_resize().
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void stack_free_block(funge_cell * entries, size_t size, bool mapped)
+{
+#ifdef HAVE_mremap
+	if (mapped) {
+		munmap(entries, size * sizeof(funge_cell));
+		return;
+	}
+#else
+	(void)size;
+	(void)mapped;
+#endif
+	free(entries);
+}
+
+/// Give back the separate allocation of a stack (if any).
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void stack_release_entries(funge_stack * restrict stack)
+{
+	if (stack->entries != stack->small)
+		stack_free_block(stack->entries, stack->size, stack->mapped);
+	stack->entries = stack->small;
+	stack->size = STACK_SMALL_SIZE;
+	stack->mapped = false;
+}
+
+/// Compute when the stack should shrink, given the current size.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void stack_update_shrink_mark(funge_stack * restrict stack)
+{
+#ifdef SEGMENTED_STACKS
+	// Upper segments are never shrunk below the segment size.
+	if (stack->below && stack->size < 2 * STACK_SEGMENT_SIZE) {
+		stack->shrink_below = 0;
+		return;
+	}
+#endif
+	// Only shrink once less than a quarter is used, so a stack that goes up
+	// and down around a boundary doesn't reallocate all the time.
+	if (stack->size > STACK_HEAP_MIN)
+		stack->shrink_below = stack->size / 4;
+	else
+		stack->shrink_below = 0;
+}
+
+/**
+ * Change the size of the entries of a stack to newsize (which must be at
+ * least the number of items in entries).
+ * Small stacks live inline in the struct, medium sized ones are allocated
+ * with malloc(), and large ones with mmap() so mremap() can be used to resize
+ * them in place.
+ * @return False on OOM, in which case the stack is unchanged.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool stack_resize(funge_stack * restrict stack, size_t newsize)
+{
+	const size_t used = STACK_LOCAL_TOP(stack);
+	funge_cell *newentries;
+	size_t bytes;
+
+	assert(newsize >= used);
+
+	if (newsize <= STACK_SMALL_SIZE) {
+		if (stack->entries != stack->small) {
+			memcpy(stack->small, stack->entries, used * sizeof(funge_cell));
+			stack_release_entries(stack);
+		}
+		stack->shrink_below = 0;
+		return true;
+	}
+	if (newsize < STACK_HEAP_MIN)
+		newsize = STACK_HEAP_MIN;
+	// Guard against overflow.
+	bytes = newsize * sizeof(funge_cell);
+	if (FUNGE_UNLIKELY(bytes / sizeof(funge_cell) != newsize))
+		return false;
+
+#ifdef HAVE_mremap
+	if (bytes >= STACK_MMAP_THRESHOLD) {
+		bytes = (bytes + stack_page_size - 1) & ~(stack_page_size - 1);
+		if (stack->mapped) {
+			newentries = mremap(stack->entries, stack->size * sizeof(funge_cell),
+			                    bytes, MREMAP_MAYMOVE);
+			if (FUNGE_UNLIKELY(newentries == MAP_FAILED))
+				return false;
+		} else {
+			newentries = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+			                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (FUNGE_UNLIKELY(newentries == MAP_FAILED))
+				return false;
+			memcpy(newentries, stack->entries, used * sizeof(funge_cell));
+			stack_release_entries(stack);
+			stack->mapped = true;
+		}
+		stack->entries = newentries;
+		stack->size = bytes / sizeof(funge_cell);
+		STATS_MAX(stack_peak, stack->size);
+		stack_update_shrink_mark(stack);
+		return true;
+	}
+	if (stack->mapped) {
+		newentries = malloc(bytes);
+		if (FUNGE_UNLIKELY(!newentries))
+			return false;
+		memcpy(newentries, stack->entries, used * sizeof(funge_cell));
+		stack_release_entries(stack);
+	} else
+#endif
+	if (stack->entries == stack->small) {
+		newentries = malloc(bytes);
+		if (FUNGE_UNLIKELY(!newentries))
+			return false;
+		memcpy(newentries, stack->small, used * sizeof(funge_cell));
+	} else {
+		newentries = realloc(stack->entries, bytes);
+		if (FUNGE_UNLIKELY(!newentries))
+			return false;
+	}
+	stack->entries = newentries;
+	stack->size = newsize;
+	STATS_MAX(stack_peak, newsize);
+	stack_update_shrink_mark(stack);
+	return true;
+}
+
+#ifdef SEGMENTED_STACKS
+/**
+ * Move the current top segment down the segment list and start a new empty
+ * one, with room for at least minfree items.
+ * @return False on OOM, in which case the stack is unchanged.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool stack_push_segment(funge_stack * restrict stack, size_t minfree)
+{
+	funge_stack_segment *seg = stack->spare;
+	const size_t used = STACK_LOCAL_TOP(stack);
+	const size_t newsize = (minfree < STACK_SEGMENT_SIZE) ? STACK_SEGMENT_SIZE : minfree + 1;
+
+	// The current top is always a heap block here, never the inline storage.
+	assert(stack->entries != stack->small);
+
+	if (seg && seg->size >= newsize) {
+		funge_cell *entries = seg->entries;
+		size_t size = seg->size;
+		bool mapped = seg->mapped;
+		stack->spare = NULL;
+		seg->entries = stack->entries;
+		seg->size = stack->size;
+		seg->mapped = stack->mapped;
+		stack->entries = entries;
+		stack->size = size;
+		stack->mapped = mapped;
+	} else {
+		seg = malloc(sizeof(funge_stack_segment));
+		if (FUNGE_UNLIKELY(!seg))
+			return false;
+		seg->entries = stack->entries;
+		seg->size = stack->size;
+		seg->mapped = stack->mapped;
+		// Let stack_resize() allocate a fresh block, as for a new stack.
+		stack->entries = stack->small;
+		stack->size = STACK_SMALL_SIZE;
+		stack->mapped = false;
+		stack->base = stack->top;
+		if (FUNGE_UNLIKELY(!stack_resize(stack, newsize))) {
+			stack->entries = seg->entries;
+			stack->size = seg->size;
+			stack->mapped = seg->mapped;
+			stack->base = stack->top - used;
+			free(seg);
+			return false;
+		}
+	}
+	seg->used = used;
+	seg->prev = stack->below;
+	stack->below = seg;
+	stack->base = stack->top;
+	stack_update_shrink_mark(stack);
+	return true;
+}
+
+/**
+ * Drop the (empty) top segment, making the one below it the top segment. The
+ * emptied block is kept as spare, in case the stack grows again.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_NOINLINE
+static void stack_pop_segment(funge_stack * restrict stack)
+{
+	funge_stack_segment *seg = stack->below;
+	funge_cell *entries = stack->entries;
+	size_t size = stack->size;
+	bool mapped = stack->mapped;
+
+	assert(seg != NULL);
+	assert(stack->top == stack->base);
+
+	stack->entries = seg->entries;
+	stack->size = seg->size;
+	stack->mapped = seg->mapped;
+	stack->base -= seg->used;
+	stack->below = seg->prev;
+
+	if (stack->spare) {
+		stack_free_block(stack->spare->entries, stack->spare->size, stack->spare->mapped);
+		free(stack->spare);
+	}
+	seg->entries = entries;
+	seg->size = size;
+	seg->mapped = mapped;
+	seg->used = 0;
+	seg->prev = NULL;
+	stack->spare = seg;
+	stack_update_shrink_mark(stack);
+}
+
+/// Free all segments below the top one, and the spare.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void stack_free_segments(funge_stack * restrict stack)
+{
+	funge_stack_segment *seg = stack->below;
+	while (seg) {
+		funge_stack_segment *prev = seg->prev;
+		stack_free_block(seg->entries, seg->size, seg->mapped);
+		free(seg);
+		seg = prev;
+	}
+	stack->below = NULL;
+	if (stack->spare) {
+		stack_free_block(stack->spare->entries, stack->spare->size, stack->spare->mapped);
+		free(stack->spare);
+		stack->spare = NULL;
+	}
+}
+#endif
+
+/// Size to grow to, to have room for at least minfree more items.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline size_t stack_grow_size(const funge_stack * restrict stack, size_t minfree)
+{
+	size_t newsize = stack->size * 2;
+#ifdef SEGMENTED_STACKS
+	// Never grow more than needed past the segment size.
+	if (newsize > STACK_SEGMENT_SIZE)
+		newsize = STACK_SEGMENT_SIZE;
+#endif
+	// Need one extra since callers check for >= size.
+	if (newsize <= STACK_LOCAL_TOP(stack) + minfree)
+		newsize = STACK_LOCAL_TOP(stack) + minfree + 1;
+	return newsize;
+}
+
+/**
+ * Make room for at least minfree more items in entries.
+ * @return False on OOM, in which case the stack is unchanged.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED FUNGE_ATTR_NOINLINE
+static bool stack_grow(funge_stack * restrict stack, size_t minfree)
+{
+	STATS_INC(stack_grows);
+	FUNGE_PROBE2(stack_grow, stack->size, stack->top);
+#ifdef SEGMENTED_STACKS
+	// A full sized segment is never copied, start a new one instead.
+	if (stack->size >= STACK_SEGMENT_SIZE && STACK_LOCAL_TOP(stack) > 0)
+		return stack_push_segment(stack, minfree);
+#endif
+	return stack_resize(stack, stack_grow_size(stack, minfree));
+}
+
+/**
+ * Shrink the stack to twice the number of items, called when top drops below
+ * shrink_below. An empty stack goes back to the inline storage.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_NOINLINE
+static void stack_shrink(funge_stack * restrict stack)
+{
+	size_t newsize = 2 * STACK_LOCAL_TOP(stack);
+
+	STATS_INC(stack_shrinks);
+	FUNGE_PROBE2(stack_shrink, stack->size, stack->top);
+#ifdef SEGMENTED_STACKS
+	if (stack->below && newsize < STACK_SEGMENT_SIZE)
+		newsize = STACK_SEGMENT_SIZE;
+#endif
+	// If this fails we just keep the larger block.
+	if (!stack_resize(stack, newsize))
+		stack->shrink_below = 0;
+}
+
 
 /******************************
  * Constructor and destructor *
@@ -41,16 +371,32 @@
 
 funge_stack * stack_create(void)
 {
-	funge_stack * tmp = (funge_stack*)malloc(sizeof(funge_stack));
+	funge_stack * tmp;
+	if (FUNGE_UNLIKELY(!stack_pool_ready)) {
+		if (FUNGE_UNLIKELY(!cf_mempool_stack_setup()))
+			return NULL;
+#ifdef HAVE_mremap
+		{
+			long pagesize = sysconf(_SC_PAGESIZE);
+			if (pagesize > 0)
+				stack_page_size = (size_t)pagesize;
+		}
+#endif
+		stack_pool_ready = true;
+	}
+	tmp = cf_mempool_stack_alloc();
 	if (FUNGE_UNLIKELY(!tmp))
 		return NULL;
-	tmp->entries = (funge_cell*)malloc(ALLOCSIZE_STACK * sizeof(funge_cell));
-	if (FUNGE_UNLIKELY(!tmp->entries)) {
-		free(tmp);
-		return NULL;
-	}
-	tmp->size = ALLOCSIZE_STACK;
+	tmp->entries = tmp->small;
+	tmp->size = STACK_SMALL_SIZE;
 	tmp->top = 0;
+	tmp->shrink_below = 0;
+	tmp->mapped = false;
+#ifdef SEGMENTED_STACKS
+	tmp->base = 0;
+	tmp->below = NULL;
+	tmp->spare = NULL;
+#endif
 	return tmp;
 }
 
@@ -58,11 +404,11 @@ FUNGE_ATTR_FAST void stack_free(funge_stack * stack)
 {
 	if (FUNGE_UNLIKELY(!stack))
 		return;
-	if (FUNGE_LIKELY(stack->entries != NULL)) {
-		free(stack->entries);
-		stack->entries = NULL;
-	}
-	free(stack);
+#ifdef SEGMENTED_STACKS
+	stack_free_segments(stack);
+#endif
+	stack_release_entries(stack);
+	cf_mempool_stack_free(stack);
 }
 
 #ifdef CONCURRENT_FUNGE
@@ -70,19 +416,19 @@ FUNGE_ATTR_FAST void stack_free(funge_stack * stack)
 FUNGE_ATTR_FAST FUNGE_ATTR_MALLOC FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
 static inline funge_stack * stack_duplicate(const funge_stack * old)
 {
-	funge_stack * tmp = (funge_stack*)malloc(sizeof(funge_stack));
+	funge_stack * tmp = stack_create();
 	if (FUNGE_UNLIKELY(!tmp))
 		return NULL;
-	tmp->entries = (funge_cell*)malloc((old->top + 1) * sizeof(funge_cell));
-	if (FUNGE_UNLIKELY(!tmp->entries)) {
-		free(tmp);
-		return NULL;
+	if (old->top >= STACK_SMALL_SIZE) {
+		if (FUNGE_UNLIKELY(!stack_resize(tmp, old->top + 1))) {
+			stack_free(tmp);
+			return NULL;
+		}
 	}
-	tmp->size = old->top + 1;
 	tmp->top = old->top;
 	// Not sure if memcpy() on 0 is well defined, so lets be careful.
 	if (tmp->top != 0)
-		memcpy(tmp->entries, old->entries, sizeof(funge_cell) * tmp->top);
+		stack_copy_range(old, 0, tmp->top, tmp->entries);
 	return tmp;
 }
 #endif
@@ -100,23 +446,9 @@ static void stack_oom(void)
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 static inline void stack_prealloc_space(funge_stack * restrict stack, size_t minfree)
 {
-	if ((stack->top + minfree) >= stack->size) {
-		size_t newsize = stack->size + minfree;
-		size_t allocation_size;
-		// Round upwards to whole ALLOCSIZE_STACK sized blocks.
-		newsize += ALLOCSIZE_STACK - (newsize % ALLOCSIZE_STACK);
-
-		// Guard against overflow.
-		allocation_size = newsize * sizeof(funge_cell);
-		if (FUNGE_UNLIKELY(allocation_size < newsize))
-		{
-			stack_oom();
-		}
-		stack->entries = (funge_cell*)realloc(stack->entries, allocation_size);
-		if (FUNGE_UNLIKELY(!stack->entries)) {
+	if ((STACK_LOCAL_TOP(stack) + minfree) >= stack->size) {
+		if (FUNGE_UNLIKELY(!stack_grow(stack, minfree)))
 			stack_oom();
-		}
-		stack->size = newsize;
 	}
 }
 
@@ -124,37 +456,45 @@ FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 static inline void stack_push_no_check(funge_stack * restrict stack, funge_cell value)
 {
 	// This should only be used if that is true...
-	assert(stack->top < stack->size);
-	stack->entries[stack->top] = value;
+	assert(STACK_LOCAL_TOP(stack) < stack->size);
+	stack->entries[STACK_LOCAL_TOP(stack)] = value;
 	stack->top++;
 }
 
 FUNGE_ATTR_FAST void stack_push(funge_stack * restrict stack, funge_cell value)
 {
 	assert(stack != NULL);
-	assert(stack->top <= stack->size);
+	assert(STACK_LOCAL_TOP(stack) <= stack->size);
 
-	// Do we need to realloc?
-	if (FUNGE_UNLIKELY(stack->top == stack->size)) {
-		funge_cell* new_entries = (funge_cell*)realloc(stack->entries, (stack->size + ALLOCSIZE_STACK) * sizeof(funge_cell));
-		if (FUNGE_UNLIKELY(!new_entries)) {
+	// Do we need to grow?
+	if (FUNGE_UNLIKELY(STACK_LOCAL_TOP(stack) == stack->size)) {
+		if (FUNGE_UNLIKELY(!stack_grow(stack, 1)))
 			stack_oom();
-		}
-		stack->entries = new_entries;
-		stack->size += ALLOCSIZE_STACK;
 	}
-	stack->entries[stack->top] = value;
+	stack->entries[STACK_LOCAL_TOP(stack)] = value;
 	stack->top++;
 }
 
 FUNGE_ATTR_FAST inline funge_cell stack_pop(funge_stack * restrict stack)
 {
+	funge_cell value;
 	assert(stack != NULL);
 
-	if (stack->top == 0)
+	if (stack->top == 0) {
+		if (FUNGE_UNLIKELY(stack->shrink_below != 0))
+			stack_shrink(stack);
 		return 0;
+	}
+#ifdef SEGMENTED_STACKS
+	if (FUNGE_UNLIKELY(stack->top == stack->base))
+		stack_pop_segment(stack);
+#endif
 
-	return stack->entries[--stack->top];
+	stack->top--;
+	value = stack->entries[STACK_LOCAL_TOP(stack)];
+	if (FUNGE_UNLIKELY(STACK_LOCAL_TOP(stack) < stack->shrink_below))
+		stack_shrink(stack);
+	return value;
 }
 
 FUNGE_ATTR_FAST void stack_discard(funge_stack * restrict stack, size_t n)
@@ -166,6 +506,16 @@ FUNGE_ATTR_FAST void stack_discard(funge_stack * restrict stack, size_t n)
 	} else {
 		stack->top = 0;
 	}
+#ifdef SEGMENTED_STACKS
+	while (FUNGE_UNLIKELY(stack->top < stack->base)) {
+		size_t newtop = stack->top;
+		stack->top = stack->base;
+		stack_pop_segment(stack);
+		stack->top = newtop;
+	}
+#endif
+	if (FUNGE_UNLIKELY(STACK_LOCAL_TOP(stack) < stack->shrink_below))
+		stack_shrink(stack);
 }
 
 
@@ -175,7 +525,12 @@ FUNGE_ATTR_FAST inline funge_cell stack_peek(const funge_stack * restrict stack)
 
 	if (stack->top == 0)
 		return 0;
-	return stack->entries[stack->top - 1];
+#ifdef SEGMENTED_STACKS
+	// Top segment may be empty right after a new one was started.
+	if (FUNGE_UNLIKELY(stack->top == stack->base))
+		return stack_get_index(stack, stack->top);
+#endif
+	return stack->entries[STACK_LOCAL_TOP(stack) - 1];
 }
 
 
@@ -188,21 +543,102 @@ FUNGE_ATTR_FAST inline funge_cell stack_get_index(const funge_stack * restrict s
 		return 0;
 	if (stack->top < index)
 		return 0;
+#ifdef SEGMENTED_STACKS
+	if (FUNGE_UNLIKELY(index <= stack->base)) {
+		// Walk down to the right segment.
+		size_t base = stack->base;
+		for (const funge_stack_segment *seg = stack->below; seg; seg = seg->prev) {
+			base -= seg->used;
+			if (index > base)
+				return seg->entries[index - 1 - base];
+		}
+		assert(false);
+		return 0;
+	}
+	return stack->entries[index - 1 - stack->base];
+#else
 	return stack->entries[index - 1];
+#endif
+}
+
+/**
+ * Find the last zero in an array of cells.
+ * @return Index of the zero plus one, or 0 if there is none.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline size_t stack_find_last_zero(const funge_cell * restrict cells, size_t count)
+{
+	size_t i = count;
+	// Test a block of cells at a time. There is no early exit inside the
+	// block, so the compiler can turn it into vector compares.
+	while (i >= 8) {
+		const funge_cell * restrict block = &cells[i - 8];
+		bool found = false;
+		for (size_t k = 0; k < 8; k++)
+			found |= (block[k] == 0);
+		if (found)
+			break;
+		i -= 8;
+	}
+	for (; i > 0; i--) {
+		if (cells[i - 1] == 0)
+			return i;
+	}
+	return 0;
 }
 
 FUNGE_ATTR_FAST inline size_t stack_strlen(const funge_stack * restrict stack)
 {
+	size_t i;
 	paranoid_assert(stack != NULL);
-	// TODO: Maybe scan two cells at once if we are using 32-bit cells on a
-	// 64-bit system?
-	for (size_t i = stack->top; i > 0; i--) {
-		if (stack->entries[i - 1] == 0)
-			return stack->top - i;
+	i = stack_find_last_zero(stack->entries, STACK_LOCAL_TOP(stack));
+	if (i != 0)
+		return STACK_LOCAL_TOP(stack) - i;
+#ifdef SEGMENTED_STACKS
+	{
+		size_t len = STACK_LOCAL_TOP(stack);
+		for (const funge_stack_segment *seg = stack->below; seg; seg = seg->prev) {
+			i = stack_find_last_zero(seg->entries, seg->used);
+			if (i != 0)
+				return len + seg->used - i;
+			len += seg->used;
+		}
 	}
+#endif
 	return stack->top;
 }
 
+FUNGE_ATTR_FAST void stack_copy_range(const funge_stack * restrict stack, size_t first,
+                                      size_t count, funge_cell * restrict dest)
+{
+	assert(first + count <= stack->top);
+#ifdef SEGMENTED_STACKS
+	{
+		// Walk down from the top segment, copying the part of each segment
+		// that overlaps the range.
+		const funge_stack_segment *seg = stack->below;
+		const funge_cell *entries = stack->entries;
+		size_t base = stack->base;
+		size_t end = first + count;
+
+		while (end > first) {
+			if (end > base) {
+				size_t from = (first > base) ? first : base;
+				memcpy(&dest[from - first], &entries[from - base], (end - from) * sizeof(funge_cell));
+				end = from;
+			}
+			if (!seg)
+				break;
+			entries = seg->entries;
+			base -= seg->used;
+			seg = seg->prev;
+		}
+	}
+#else
+	memcpy(dest, &stack->entries[first], count * sizeof(funge_cell));
+#endif
+}
+
 
 /********************************
  * Push and pop for data types. *
@@ -234,33 +670,49 @@ FUNGE_ATTR_FAST void stack_push_string(funge_stack * restrict stack, const unsig
 	// Increment it once or it won't work
 	stack_prealloc_space(stack, len + 1);
 	{
-		const size_t top = stack->top + len;
+		const size_t top = STACK_LOCAL_TOP(stack) + len;
 		for (ssize_t i = (ssize_t)len; i >= 0; i--)
 			stack->entries[top - (size_t)i] = str[i];
 		stack->top += len + 1;
 	}
 }
 
+/// Copy the top len cells of the stack to buf as bytes, in string order.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void stack_copy_string(const funge_stack * restrict stack,
+                                     size_t len, unsigned char * restrict buf)
+{
+	const funge_cell * restrict src;
+#ifdef SEGMENTED_STACKS
+	if (FUNGE_UNLIKELY(len > STACK_LOCAL_TOP(stack))) {
+		for (size_t i = 0; i < len; i++)
+			buf[i] = (unsigned char)stack_get_index(stack, stack->top - i);
+		return;
+	}
+#endif
+	src = &stack->entries[STACK_LOCAL_TOP(stack) - len];
+	for (size_t i = 0; i < len; i++)
+		buf[i] = (unsigned char)src[len - 1 - i];
+}
+
 FUNGE_ATTR_FAST unsigned char *stack_pop_string(funge_stack * restrict stack, size_t * restrict len)
 {
-	funge_cell c;
-	size_t index = 0;
+	size_t n;
 	unsigned char *buf;
 	paranoid_assert(stack != NULL);
-	// FIXME: This may very likely be more than is needed.
-	buf = (unsigned char*)malloc((stack->top + 1) * sizeof(unsigned char));
+	n = stack_strlen(stack);
+	buf = (unsigned char*)malloc((n + 1) * sizeof(unsigned char));
 	if (FUNGE_UNLIKELY(!buf)) {
 		if (len)
 			*len = 0;
 		return NULL;
 	}
-
-	while ((c = stack_pop(stack)) != '\0') {
-		buf[index++] = (unsigned char)c;
-	}
-	buf[index] = '\0';
+	stack_copy_string(stack, n, buf);
+	buf[n] = '\0';
+	// Also drop the terminating 0.
+	stack_discard(stack, n + 1);
 	if (len)
-		*len = index;
+		*len = n;
 	return buf;
 }
 
@@ -271,33 +723,132 @@ FUNGE_ATTR_FAST void stack_push_string_multibyte(funge_stack * restrict stack, c
 	// Increment it once or it won't work
 	stack_prealloc_space(stack, len + 1);
 	{
-		const size_t top = stack->top + len;
+		const size_t top = STACK_LOCAL_TOP(stack) + len;
 		for (ssize_t i = (ssize_t)len; i >= 0; i--)
 			stack->entries[top - (size_t)i] = str[i];
 		stack->top += len + 1;
 	}
 }
 
+/// Copy the top len cells of the stack to buf, in string order.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void stack_copy_string_multibyte(const funge_stack * restrict stack,
+                                               size_t len, funge_cell * restrict buf)
+{
+	const funge_cell * restrict src;
+#ifdef SEGMENTED_STACKS
+	if (FUNGE_UNLIKELY(len > STACK_LOCAL_TOP(stack))) {
+		for (size_t i = 0; i < len; i++)
+			buf[i] = stack_get_index(stack, stack->top - i);
+		return;
+	}
+#endif
+	src = &stack->entries[STACK_LOCAL_TOP(stack) - len];
+	for (size_t i = 0; i < len; i++)
+		buf[i] = src[len - 1 - i];
+}
+
 FUNGE_ATTR_FAST funge_cell *stack_pop_string_multibyte(funge_stack * restrict stack, size_t * restrict len)
 {
-	funge_cell c;
-	size_t index = 0;
+	size_t n;
 	funge_cell *buf;
 	paranoid_assert(stack != NULL);
-	// FIXME: This may very likely be more than is needed.
-	buf = (funge_cell*)malloc((stack->top + 1) * sizeof(funge_cell));
+	n = stack_strlen(stack);
+	buf = (funge_cell*)malloc((n + 1) * sizeof(funge_cell));
+	if (FUNGE_UNLIKELY(!buf)) {
+		if (len)
+			*len = 0;
+		return NULL;
+	}
+	stack_copy_string_multibyte(stack, n, buf);
+	buf[n] = 0;
+	stack_discard(stack, n + 1);
+	if (len)
+		*len = n;
+	return buf;
+}
+
+/// Scratch buffers for the *_scratch pop functions.
+static struct {
+	unsigned char *bytes;      ///< Buffer for stack_pop_string_scratch().
+	size_t         bytes_size; ///< Size of bytes.
+	funge_cell    *cells;      ///< Buffer for stack_pop_string_multibyte_scratch().
+	size_t         cells_size; ///< Size of cells.
+} stack_scratch[STACK_SCRATCH_SLOTS];
+
+/**
+ * Make sure a scratch buffer can hold at least needed items.
+ * @return The (possibly moved) buffer, or NULL on OOM, in which case the old
+ *         buffer is still valid.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR((nonnull(2))) FUNGE_ATTR_WARN_UNUSED
+static void * stack_scratch_reserve(void * buf, size_t * size, size_t needed, size_t itemsize)
+{
+	void *newbuf;
+	size_t newsize;
+	if (FUNGE_LIKELY(needed <= *size))
+		return buf;
+	newsize = *size * 2;
+	if (newsize < needed)
+		newsize = needed;
+	if (newsize < 256)
+		newsize = 256;
+	if (FUNGE_UNLIKELY(newsize * itemsize / itemsize != newsize))
+		return NULL;
+	newbuf = realloc(buf, newsize * itemsize);
+	if (FUNGE_UNLIKELY(!newbuf))
+		return NULL;
+	*size = newsize;
+	return newbuf;
+}
+
+FUNGE_ATTR_FAST unsigned char *stack_pop_string_scratch(funge_stack * restrict stack,
+                                                        size_t * restrict len,
+                                                        unsigned int slot)
+{
+	size_t n;
+	unsigned char *buf;
+	paranoid_assert(stack != NULL);
+	assert(slot < STACK_SCRATCH_SLOTS);
+	n = stack_strlen(stack);
+	buf = stack_scratch_reserve(stack_scratch[slot].bytes, &stack_scratch[slot].bytes_size,
+	                            n + 1, sizeof(unsigned char));
 	if (FUNGE_UNLIKELY(!buf)) {
 		if (len)
 			*len = 0;
 		return NULL;
 	}
+	stack_scratch[slot].bytes = buf;
+	stack_copy_string(stack, n, buf);
+	buf[n] = '\0';
+	stack_discard(stack, n + 1);
+	if (len)
+		*len = n;
+	return buf;
+}
 
-	while ((c = stack_pop(stack)) != '\0') {
-		buf[index++] = c;
+FUNGE_ATTR_FAST funge_cell *stack_pop_string_multibyte_scratch(funge_stack * restrict stack,
+                                                               size_t * restrict len,
+                                                               unsigned int slot)
+{
+	size_t n;
+	funge_cell *buf;
+	paranoid_assert(stack != NULL);
+	assert(slot < STACK_SCRATCH_SLOTS);
+	n = stack_strlen(stack);
+	buf = stack_scratch_reserve(stack_scratch[slot].cells, &stack_scratch[slot].cells_size,
+	                            n + 1, sizeof(funge_cell));
+	if (FUNGE_UNLIKELY(!buf)) {
+		if (len)
+			*len = 0;
+		return NULL;
 	}
-	buf[index] = '\0';
+	stack_scratch[slot].cells = buf;
+	stack_copy_string_multibyte(stack, n, buf);
+	buf[n] = 0;
+	stack_discard(stack, n + 1);
 	if (len)
-		*len = index;
+		*len = n;
 	return buf;
 }
 
@@ -361,7 +912,7 @@ void stack_dump(const funge_stack * stack)
 		return;
 	fprintf(stderr, "%zu elements:\n", stack->top);
 	for (size_t i = 0; i < stack->top; i++)
-		fprintf(stderr, "%" FUNGECELLPRI " ", stack->entries[i]);
+		fprintf(stderr, "%" FUNGECELLPRI " ", stack_get_index(stack, i + 1));
 	fputs("\n", stderr);
 }
 
@@ -378,7 +929,7 @@ void stack_print_top(const funge_stack * stack)
 	} else {
 		fprintf(stderr, "\tStack has %zu elements, top 15 (or less) elements:\n\t\t", stack->top);
 		for (ssize_t i = (ssize_t)stack->top; (i > 0) && (i > ((ssize_t)stack->top - 15)); i--)
-			fprintf(stderr, "%" FUNGECELLPRI " ", stack->entries[i - 1]);
+			fprintf(stderr, "%" FUNGECELLPRI " ", stack_get_index(stack, (size_t)i));
 		fputs("\n", stderr);
 	}
 }
@@ -467,26 +1018,8 @@ FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 static inline bool stack_prealloc_space_non_fatal(funge_stack * restrict stack, size_t minfree)
 {
 	paranoid_assert(stack != NULL);
-	if ((stack->top + minfree) >= stack->size) {
-		size_t newsize = stack->size + minfree;
-		size_t allocation_size;
-		funge_cell* newentries;
-		// Round upwards to whole ALLOCSIZE_STACKed blocks.
-		newsize += ALLOCSIZE_STACK - (newsize % ALLOCSIZE_STACK);
-
-		// Guard against overflow.
-		allocation_size = newsize * sizeof(funge_cell);
-		if (FUNGE_UNLIKELY(allocation_size < newsize))
-		{
-			return false;
-		}
-		newentries = (funge_cell*)realloc(stack->entries, allocation_size);
-		if (FUNGE_UNLIKELY(!newentries)) {
-			return false;
-		}
-		stack->entries = newentries;
-		stack->size = newsize;
-	}
+	if ((STACK_LOCAL_TOP(stack) + minfree) >= stack->size)
+		return stack_grow(stack, minfree);
 	return true;
 }
 
@@ -495,7 +1028,7 @@ static inline void stack_zero_fill(funge_stack * restrict stack, size_t count)
 {
 	paranoid_assert(stack != NULL);
 	stack_prealloc_space(stack, count);
-	memset(&stack->entries[stack->top], 0, count * sizeof(funge_cell));
+	memset(&stack->entries[STACK_LOCAL_TOP(stack)], 0, count * sizeof(funge_cell));
 	stack->top += count;
 }
 
@@ -517,8 +1050,8 @@ inline void stack_bulk_copy(funge_stack * restrict dest,
 		stack_zero_fill(dest, zero_count);
 	}
 
-	// memcpy the rest.
-	memcpy(&dest->entries[dest->top], &src->entries[src->top - count], count * sizeof(funge_cell));
+	// Copy the rest.
+	stack_copy_range(src, src->top - count, count, &dest->entries[STACK_LOCAL_TOP(dest)]);
 	dest->top += count;
 }
 
@@ -566,10 +1099,7 @@ bool stackstack_begin(instructionPointer * ip, funge_cell count, const funge_vec
 	if (count > 0) {
 		stack_bulk_copy(TOSS, SOSS, (size_t)count);
 		// Make it into a move.
-		if ((size_t)count > SOSS->top)
-			SOSS->top = 0;
-		else
-			SOSS->top -= (size_t)count;
+		stack_discard(SOSS, (size_t)count);
 	} else if (count < 0) {
 		stack_zero_fill(SOSS, (size_t)(-count));
 	}
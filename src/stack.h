@@ -29,6 +29,7 @@
 
 #include "global.h"
 
+#include <stdbool.h>
 #include <sys/types.h>
 #include <stdint.h>
 
@@ -37,13 +38,37 @@
 /// Forward decl, see ip.h
 struct s_instructionPointer;
 
+/// Number of cells stored inline in the stack struct, before any separate
+/// allocation is made.
+#define STACK_SMALL_SIZE 8
+
+#ifdef SEGMENTED_STACKS
+/// A full chunk below the top one in a segmented stack.
+typedef struct funge_stack_segment {
+	struct funge_stack_segment *prev; ///< Next segment downwards, NULL for the bottom one.
+	funge_cell *entries; ///< Pointer to entries.
+	size_t      size;    ///< Allocated size of entries.
+	size_t      used;    ///< Number of items in this segment.
+	bool        mapped;  ///< True if entries was allocated with mmap().
+} funge_stack_segment;
+#endif
+
 /// A Funge stack.
 /// @warning Don't access directly, use functions and macros below.
 typedef struct funge_stack {
 	size_t      size;    ///< This is current size of the array entries.
 	size_t      top;     /**< This is current top item in stack (may not be last item).
 	                          Note: One-indexed, as 0 = empty stack. */
-	funge_cell *entries; ///< Pointer to entries.
+	funge_cell *entries; /**< Pointer to entries. Points to small if size is STACK_SMALL_SIZE.
+	                          With SEGMENTED_STACKS this is only the top segment. */
+	size_t      shrink_below; ///< Shrink entries when top drops below this.
+	bool        mapped;  ///< True if entries was allocated with mmap().
+#ifdef SEGMENTED_STACKS
+	size_t      base;    ///< Number of items in the segments below entries.
+	funge_stack_segment *below; ///< Segments below entries, top-most first.
+	funge_stack_segment *spare; ///< Last emptied segment, kept to avoid thrashing.
+#endif
+	funge_cell  small[STACK_SMALL_SIZE]; ///< Inline storage for small stacks.
 } funge_stack;
 
 /// A Funge stack-stack.
@@ -102,6 +127,16 @@ funge_cell stack_get_index(const funge_stack * restrict stack, size_t index);
  */
 FUNGE_ATTR_WARN_UNUSED FUNGE_ATTR_NONNULL FUNGE_ATTR_FAST FUNGE_ATTR_PURE
 size_t stack_strlen(const funge_stack * restrict stack);
+/**
+ * Copy items from the stack to an array, bottom-most first.
+ * @param stack Stack to copy from.
+ * @param first Zero-based index of first item to copy (0 = bottom of stack).
+ * @param count Number of items to copy, first + count must be at most top.
+ * @param dest Array to copy to.
+ */
+FUNGE_ATTR_NONNULL FUNGE_ATTR_FAST
+void stack_copy_range(const funge_stack * restrict stack, size_t first,
+                      size_t count, funge_cell * restrict dest);
 
 
 
@@ -161,6 +196,29 @@ funge_cell * stack_pop_string_multibyte(funge_stack * restrict stack,
  */
 #define stack_free_string(string) free(string)
 
+/// Number of scratch buffers for the *_scratch functions below.
+#define STACK_SCRATCH_SLOTS 2
+
+/**
+ * Pop a 0gnirts string into a reusable scratch buffer, instead of allocating
+ * a new one like stack_pop_string().
+ * @param stack Stack to pop from.
+ * @param len Set to length of string (excluding the terminating NUL) if not NULL.
+ * @param slot Which scratch buffer to use (less than STACK_SCRATCH_SLOTS). Use
+ *             different slots if more than one string is needed at once.
+ * @return The NUL terminated string, valid until the next call using the same
+ *         slot. NULL if out of memory. Must not be freed.
+ */
+FUNGE_ATTR_WARN_UNUSED FUNGE_ATTR((nonnull(1))) FUNGE_ATTR_FAST
+unsigned char * stack_pop_string_scratch(funge_stack * restrict stack,
+                                         size_t * restrict len,
+                                         unsigned int slot);
+/// Like stack_pop_string_scratch(), but keeps the cells as they are.
+FUNGE_ATTR_WARN_UNUSED FUNGE_ATTR((nonnull(1))) FUNGE_ATTR_FAST
+funge_cell * stack_pop_string_multibyte_scratch(funge_stack * restrict stack,
+                                                size_t * restrict len,
+                                                unsigned int slot);
+
 #ifdef UNUSED
 /**
  * Pop a fixed number of chars from a stack.
@@ -173,8 +231,8 @@ unsigned char * stack_pop_sized_string(funge_stack * restrict stack,
                                        size_t len);
 #endif
 
-/// Clear all items from a stack.
-#define stack_clear(stack) { (stack)->top = 0; }
+/// Clear all items from a stack, giving back any separate allocation.
+#define stack_clear(stack) stack_discard((stack), (stack)->top)
 /**
  * Duplicate top element of the stack.
  */
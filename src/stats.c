@@ -0,0 +1,126 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "stats.h"
+
+#ifdef ENABLE_STATS
+
+#include "funge-space/funge-space.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+fungeStats stats;
+volatile sig_atomic_t stats_requested = 0;
+
+/// Index of the most executed opcode not yet printed, or -1.
+static int stats_next_opcode(const bool * restrict printed)
+{
+	int best = -1;
+	for (int i = 0; i < 256; i++) {
+		if (printed[i] || stats.instructions[i] == 0)
+			continue;
+		if (best == -1 || stats.instructions[i] > stats.instructions[best])
+			best = i;
+	}
+	return best;
+}
+
+/// Printable form of opcode, for the tables.
+static char stats_char(int opcode)
+{
+	return (opcode >= 32 && opcode < 127) ? (char)opcode : '?';
+}
+
+void stats_print(void)
+{
+	fungeSpaceHashStats hash;
+	uint64_t total = stats.instructions_other;
+	uint64_t fingerprints = 0;
+	bool printed[256] = { false };
+	int opcode;
+
+	stats_requested = 0;
+	for (int i = 0; i < 256; i++)
+		total += stats.instructions[i];
+	for (int i = 0; i < 26; i++)
+		fingerprints += stats.fingerprint_calls[i];
+	fungespace_hash_stats(&hash);
+
+	fprintf(stderr, "Statistics:\n"
+	        "Instructions:         %" PRIu64 " (plus %" PRIu64 " cells in string mode)\n",
+	        total, stats.string_mode);
+	// Most executed first.
+	while ((opcode = stats_next_opcode(printed)) != -1) {
+		printed[opcode] = true;
+		fprintf(stderr, "  %c %3d  %14" PRIu64 " %6.2f%%\n",
+		        stats_char(opcode), opcode, stats.instructions[opcode],
+		        100.0 * (double)stats.instructions[opcode] / (double)total);
+	}
+	if (stats.instructions_other)
+		fprintf(stderr, "  other   %14" PRIu64 "\n", stats.instructions_other);
+	fprintf(stderr,
+	        "Funge-Space reads:    %" PRIu64 " static, %" PRIu64 " hash\n"
+	        "Funge-Space writes:   %" PRIu64 " static, %" PRIu64 " hash\n"
+	        "Wraps:                %" PRIu64 "\n"
+	        "Bounds rescans:       %" PRIu64 "\n"
+	        "Hash table:           %zu entries in %zu buckets (load %.2f), "
+	        "%zu chains, longest %zu\n"
+	        "Stack reallocations:  %" PRIu64 " grow, %" PRIu64 " shrink, "
+	        "largest %zu cells\n"
+	        "IPs:                  %" PRIu64 " created, %" PRIu64 " terminated, "
+	        "peak %zu\n"
+	        "Fingerprint calls:    %" PRIu64 " (plus %" PRIu64 " with nothing loaded)\n",
+	        stats.fspace_get_static, stats.fspace_get_hash,
+	        stats.fspace_set_static, stats.fspace_set_hash,
+	        stats.wraps, stats.minimize_bounds,
+	        hash.entries, hash.buckets,
+	        hash.buckets ? (double)hash.entries / (double)hash.buckets : 0.0,
+	        hash.chains, hash.longest_chain,
+	        stats.stack_grows, stats.stack_shrinks, stats.stack_peak,
+	        stats.ips_created, stats.ips_terminated, stats.ips_peak,
+	        fingerprints, stats.fingerprint_missing);
+	for (int i = 0; i < 26; i++) {
+		if (stats.fingerprint_calls[i])
+			fprintf(stderr, "  %c       %14" PRIu64 "\n", 'A' + i, stats.fingerprint_calls[i]);
+	}
+}
+
+static void stats_signal(int signum)
+{
+	(void)signum;
+	stats_requested = 1;
+}
+
+void stats_setup(void)
+{
+	struct sigaction action;
+
+	atexit(&stats_print);
+	action.sa_handler = &stats_signal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &action, NULL);
+}
+
+#endif /* ENABLE_STATS */
@@ -0,0 +1,106 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Runtime counters (-x option, needs ENABLE_STATS at build time).
+ *
+ * The counters are always updated in a binary built with ENABLE_STATS, -x
+ * only decides if they are printed, at exit and on SIGUSR1. Without
+ * ENABLE_STATS the STATS_* macros expand to nothing.
+ *
+ * Counters are plain integers, so -x turns off -P to keep them exact.
+ */
+
+#ifndef FUNGE_HAD_SRC_STATS_H
+#define FUNGE_HAD_SRC_STATS_H
+
+#include "global.h"
+
+#ifdef ENABLE_STATS
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct fungeStats {
+	uint64_t instructions[256];     ///< Executed instructions by opcode.
+	uint64_t instructions_other;    ///< Opcodes outside 0-255.
+	uint64_t string_mode;           ///< Cells pushed or skipped in string mode.
+	uint64_t fspace_get_static;     ///< Reads from the static area.
+	uint64_t fspace_get_hash;       ///< Reads from the hash table.
+	uint64_t fspace_set_static;     ///< Writes to the static area.
+	uint64_t fspace_set_hash;       ///< Writes to the hash table.
+	uint64_t wraps;                 ///< IP moves that left the bounds.
+	uint64_t minimize_bounds;       ///< Bounds rescans (exact bounds only).
+	uint64_t stack_grows;           ///< Stack reallocations to a larger size.
+	uint64_t stack_shrinks;         ///< Stack reallocations to a smaller size.
+	size_t   stack_peak;            ///< Largest stack allocation in cells.
+	uint64_t ips_created;           ///< Including the initial IP.
+	uint64_t ips_terminated;
+	size_t   ips_peak;              ///< Most IPs alive at the same time.
+	uint64_t fingerprint_calls[26]; ///< Fingerprint instructions by letter.
+	uint64_t fingerprint_missing;   ///< A-Z executed with nothing loaded.
+} fungeStats;
+
+extern fungeStats stats;
+/// Set by the SIGUSR1 handler, the main loop prints the counters.
+extern volatile sig_atomic_t stats_requested;
+
+#  define STATS_INC(field) (stats.field++)
+#  define STATS_OPCODE(opcode) \
+	((void)(((opcode) >= 0 && (opcode) < 256) \
+	        ? stats.instructions[(opcode)]++ : stats.instructions_other++))
+#  define STATS_MAX(field, value) \
+	do { \
+		if ((value) > stats.field) \
+			stats.field = (value); \
+	} while (0)
+
+/// Print the counters now if SIGUSR1 was received.
+#  define STATS_POLL() \
+	do { \
+		if (FUNGE_UNLIKELY(stats_requested)) \
+			stats_print(); \
+	} while (0)
+
+/**
+ * Print the counters to stderr at exit and on SIGUSR1.
+ */
+FUNGE_ATTR_COLD
+void stats_setup(void);
+
+/**
+ * Print the counters to stderr.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NOINLINE
+void stats_print(void);
+
+#else
+
+#  define STATS_INC(field) ((void)0)
+#  define STATS_OPCODE(opcode) ((void)0)
+#  define STATS_MAX(field, value) ((void)0)
+#  define STATS_POLL() ((void)0)
+
+#endif /* ENABLE_STATS */
+
+#endif
@@ -0,0 +1,181 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "trace.h"
+#include "diagnostic.h"
+#include "stack.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Records per write() in stream mode, 384 KiB.
+#define TRACE_STREAM_RECORDS 8192
+
+bool trace_enabled = false;
+
+static traceRecord * trace_buffer = NULL;
+static size_t        trace_size = 0;
+/// Where the next record goes.
+static size_t        trace_next = 0;
+/// Ring mode only: true once older records have been overwritten.
+static bool          trace_wrapped = false;
+static bool          trace_ring = false;
+static int           trace_fd = -1;
+
+/// Set by the SIGUSR2 handler, trace_record() then writes the trace.
+static volatile sig_atomic_t trace_dump_requested = 0;
+
+/// Signals we write the trace for before dying.
+static const int trace_fatal_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+/// Only uses async-signal-safe functions.
+static void trace_write_all(const void * buf, size_t len)
+{
+	const char * p = buf;
+
+	while (len > 0) {
+		ssize_t n = write(trace_fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+}
+
+static void trace_write_header(uint32_t flags)
+{
+	traceHeader header;
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.recordSize = sizeof(traceRecord);
+	header.flags = flags;
+#ifdef CONCURRENT_FUNGE
+	header.flags |= TRACE_FLAG_CONCURRENT;
+#endif
+	trace_write_all(&header, sizeof(header));
+}
+
+/// Write what we have, safe to call from a signal handler.
+static void trace_dump(void)
+{
+	if (trace_fd == -1)
+		return;
+	if (trace_ring) {
+		// Each dump replaces the previous one.
+		if (lseek(trace_fd, 0, SEEK_SET) != 0 || ftruncate(trace_fd, 0) != 0)
+			return;
+		trace_write_header(TRACE_FLAG_RING);
+		if (trace_wrapped)
+			trace_write_all(trace_buffer + trace_next, (trace_size - trace_next) * sizeof(traceRecord));
+		trace_write_all(trace_buffer, trace_next * sizeof(traceRecord));
+	} else {
+		trace_write_all(trace_buffer, trace_next * sizeof(traceRecord));
+		trace_next = 0;
+	}
+}
+
+FUNGE_ATTR_FAST
+void trace_record(const instructionPointer * restrict ip, ssize_t tix, funge_cell opcode)
+{
+	traceRecord * restrict r = &trace_buffer[trace_next];
+
+	r->x      = ip->position.x;
+	r->y      = ip->position.y;
+	r->opcode = opcode;
+	r->tos    = stack_peek(ip->stack);
+	r->id     = ip->ID;
+	r->depth  = ip->stack->top > UINT32_MAX ? UINT32_MAX : (uint32_t)ip->stack->top;
+	r->tix    = (int32_t)tix;
+
+	if (FUNGE_UNLIKELY(++trace_next == trace_size)) {
+		if (trace_ring) {
+			trace_next = 0;
+			trace_wrapped = true;
+		} else {
+			trace_dump();
+		}
+	}
+	if (FUNGE_UNLIKELY(trace_dump_requested)) {
+		trace_dump_requested = 0;
+		trace_dump();
+	}
+}
+
+static void trace_at_exit(void)
+{
+	trace_dump();
+	close(trace_fd);
+	trace_fd = -1;
+	trace_enabled = false;
+	free(trace_buffer);
+}
+
+static void trace_signal_dump(int signum)
+{
+	(void)signum;
+	trace_dump_requested = 1;
+}
+
+static void trace_signal_fatal(int signum)
+{
+	// SA_RESETHAND restored the default action, so this kills us.
+	trace_dump();
+	raise(signum);
+}
+
+void trace_setup(const char * restrict filename, size_t ringSize)
+{
+	struct sigaction action;
+
+	trace_ring = ringSize > 0;
+	trace_size = trace_ring ? ringSize : TRACE_STREAM_RECORDS;
+	trace_buffer = malloc(trace_size * sizeof(traceRecord));
+	if (FUNGE_UNLIKELY(!trace_buffer)) {
+		DIAG_OOM("Couldn't allocate trace buffer");
+	}
+	trace_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (trace_fd == -1) {
+		diag_fatal_format("Failed to open trace file \"%s\": %s", filename, strerror(errno));
+	}
+	fcntl(trace_fd, F_SETFD, FD_CLOEXEC);
+	if (!trace_ring)
+		trace_write_header(0);
+	trace_enabled = true;
+	atexit(&trace_at_exit);
+
+	sigemptyset(&action.sa_mask);
+	action.sa_handler = &trace_signal_dump;
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &action, NULL);
+
+	action.sa_handler = &trace_signal_fatal;
+	action.sa_flags = (int)SA_RESETHAND;
+	for (size_t i = 0; i < sizeof(trace_fatal_signals) / sizeof(trace_fatal_signals[0]); i++)
+		sigaction(trace_fatal_signals[i], &action, NULL);
+}
@@ -0,0 +1,99 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Binary instruction trace (-T and -K options).
+ *
+ * Every executed instruction is stored as a fixed size traceRecord in an
+ * in-memory buffer. In stream mode (-T file) the buffer is written to the
+ * file with one large write() each time it fills up. In ring mode (-K records
+ * as well) only the last records are kept, and the file is (re)written at
+ * exit, on SIGUSR2 and on fatal signals such as SIGSEGV.
+ *
+ * The file starts with a traceHeader, followed by the records in execution
+ * order. Both use host byte order, tools/trace-decode.py reads them and can
+ * print the same text as -t.
+ */
+
+#ifndef FUNGE_HAD_SRC_TRACE_H
+#define FUNGE_HAD_SRC_TRACE_H
+
+#include "global.h"
+#include "ip.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/// Magic at start of file, includes format version.
+#define TRACE_MAGIC "CFTRACE1"
+
+typedef struct traceHeader {
+	char     magic[8];    ///< TRACE_MAGIC, not NUL terminated.
+	uint32_t recordSize;  ///< sizeof(traceRecord), also tells the byte order.
+	uint32_t flags;       ///< TRACE_FLAG_*.
+} traceHeader;
+
+/// Set if the file only has the last records of the run.
+#define TRACE_FLAG_RING       0x1
+/// Set if tix is valid (concurrent build).
+#define TRACE_FLAG_CONCURRENT 0x2
+
+typedef struct traceRecord {
+	int64_t  x;      ///< Position of the instruction.
+	int64_t  y;
+	int64_t  opcode; ///< Instruction about to execute.
+	int64_t  tos;    ///< Top of stack before it executes, 0 if empty.
+	int64_t  id;     ///< IP ID.
+	uint32_t depth;  ///< Number of elements on the stack, saturated.
+	int32_t  tix;    ///< Index in IP list, -1 if not concurrent.
+} traceRecord;
+
+/// True if -T was given.
+extern bool trace_enabled;
+
+/**
+ * Open the trace file and register the handlers.
+ * @param filename File to write to.
+ * @param ringSize Keep only this many records, 0 to stream all of them.
+ */
+FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+void trace_setup(const char * restrict filename, size_t ringSize);
+
+/**
+ * Append a record for ip, which is about to execute opcode.
+ * @param tix Index in IP list, -1 if not concurrent.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void trace_record(const instructionPointer * restrict ip, ssize_t tix, funge_cell opcode);
+
+#ifndef DISABLE_TRACE
+#  define TRACE_RECORD(ip, tix, opcode) \
+	do { \
+		if (FUNGE_UNLIKELY(trace_enabled)) \
+			trace_record((ip), (tix), (opcode)); \
+	} while (0)
+#else
+#  define TRACE_RECORD(ip, tix, opcode) /* NO-OP */
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Runs a program with its input and output going through a memory backend
+ * instead of stdin and stdout, the way an embedding program would, and
+ * compares the captured output with the expected output.
+ * Usage: iobackend program expected [input]
+ */
+
+#include "global.h"
+#include "interpreter.h"
+#include "iobackend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Normally defined in main.c, which isn't linked in.
+const char *const *fungeargv = NULL;
+int fungeargc = 0;
+
+static ioMemoryBackend memory_io;
+static unsigned char *expected;
+static size_t expected_len;
+
+/// Read a whole file, exit on errors.
+static unsigned char *read_file(const char *filename, size_t *len)
+{
+	FILE *f = fopen(filename, "rb");
+	unsigned char *data = NULL;
+	size_t size = 0;
+
+	*len = 0;
+	if (!f) {
+		perror(filename);
+		exit(EXIT_FAILURE);
+	}
+	while (!feof(f)) {
+		unsigned char *newdata = realloc(data, size + 4096);
+		if (!newdata) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+		data = newdata;
+		size += 4096;
+		*len += fread(data + *len, 1, size - *len, f);
+		if (ferror(f)) {
+			perror(filename);
+			exit(EXIT_FAILURE);
+		}
+	}
+	fclose(f);
+	return data;
+}
+
+/// Runs after the interpreter has flushed its output at exit.
+static void check_output(void)
+{
+	if (memory_io.output_len == expected_len
+	    && memcmp(memory_io.output, expected, expected_len) == 0)
+		return;
+	fputs("Expected output:\n", stderr);
+	fwrite(expected, 1, expected_len, stderr);
+	fputs("\nActual output:\n", stderr);
+	fwrite(memory_io.output, 1, memory_io.output_len, stderr);
+	fputs("\n", stderr);
+	_exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char *input = NULL;
+	size_t input_len = 0;
+
+	if (argc < 3 || argc > 4) {
+		fprintf(stderr, "Usage: %s program expected [input]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	expected = read_file(argv[2], &expected_len);
+	if (argc == 4)
+		input = read_file(argv[3], &input_len);
+	io_memory_init(&memory_io, input, input_len);
+	io_set_input(&memory_io.io);
+	io_set_output(&memory_io.io);
+	// Registered before the interpreter registers its flush, so it runs after.
+	atexit(&check_output);
+
+	fungeargc = 1;
+	fungeargv = (const char * const *)&argv[1];
+	interpreter_run(argv[1]);
+}
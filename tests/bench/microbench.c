@@ -0,0 +1,387 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Microbenchmarks for Funge-Space, stacks, the IP list and the mempools,
+ * linked directly against the interpreter sources. Build with
+ * "make microbench". Usage: microbench [-n repeats] [substring...]
+ *
+ * Each benchmark runs a fixed number of iterations, and the fastest of the
+ * repeats is reported as time and (on x86) TSC cycles per iteration.
+ */
+
+#include "global.h"
+#include "ip.h"
+#include "rect.h"
+#include "stack.h"
+#include "vector.h"
+#include "funge-space/funge-space.h"
+
+#define CFUNGE_MEMPOOL_STACKS
+#include "../lib/mempool/cfunge_mempool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_clock_gettime
+#  include <time.h>
+#else
+#  include <sys/time.h>
+#endif
+
+// Normally defined in main.c, which isn't linked in.
+const char *const *fungeargv = NULL;
+int fungeargc = 0;
+
+/// Side of the square used in the dense window and the hash region.
+#define SIDE 256
+/// Where the hash region square starts, far outside the static window.
+#define HASH_X 1048576
+/// Number of precomputed random coordinates, must be a power of two.
+#define RANDOM_COUNT 65536
+
+typedef struct s_microBench {
+	const char *name;
+	void (*run)(size_t iterations);
+	size_t iterations;
+} microBench;
+
+/// Results go here so the compiler can't drop the work.
+static volatile funge_cell sink;
+static funge_vector random_coords[RANDOM_COUNT];
+
+/*********
+ * Timer *
+ *********/
+
+FUNGE_ATTR_FAST
+static inline uint64_t read_cycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+FUNGE_ATTR_FAST
+static inline uint64_t read_ns(void)
+{
+#ifdef HAVE_clock_gettime
+	struct timespec ts;
+#  if defined(_POSIX_MONOTONIC_CLOCK) && (_POSIX_MONOTONIC_CLOCK > 0)
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#  else
+	clock_gettime(CLOCK_REALTIME, &ts);
+#  endif
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000u + (uint64_t)tv.tv_usec * 1000u;
+#endif
+}
+
+/***************
+ * Funge-Space *
+ ***************/
+
+static void fill_square(funge_cell base_x)
+{
+	for (funge_cell y = 0; y < SIDE; y++)
+		for (funge_cell x = 0; x < SIDE; x++)
+			fungespace_set('a' + ((x + y) & 15), &(funge_vector) { base_x + x, y });
+}
+
+static void setup_fungespace(void)
+{
+	uint64_t state = 0x9E3779B97F4A7C15u;
+
+	if (!fungespace_create()) {
+		perror("fungespace_create");
+		exit(EXIT_FAILURE);
+	}
+	fill_square(0);
+	fill_square(HASH_X);
+	// xorshift64, only needs to be the same on every run.
+	for (size_t i = 0; i < RANDOM_COUNT; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		random_coords[i].x = (funge_cell)(state % SIDE);
+		random_coords[i].y = (funge_cell)((state >> 32) % SIDE);
+	}
+}
+
+static inline void get_sequential(size_t iterations, funge_cell base_x)
+{
+	funge_cell sum = 0;
+	for (size_t i = 0; i < iterations; i++) {
+		funge_vector pos = { base_x + (funge_cell)(i % SIDE), (funge_cell)((i / SIDE) % SIDE) };
+		sum += fungespace_get(&pos);
+	}
+	sink = sum;
+}
+
+static inline void get_random(size_t iterations, funge_cell base_x)
+{
+	funge_cell sum = 0;
+	for (size_t i = 0; i < iterations; i++) {
+		const funge_vector *r = &random_coords[i & (RANDOM_COUNT - 1)];
+		sum += fungespace_get(&(funge_vector) { base_x + r->x, r->y });
+	}
+	sink = sum;
+}
+
+static inline void set_sequential(size_t iterations, funge_cell base_x)
+{
+	for (size_t i = 0; i < iterations; i++) {
+		funge_vector pos = { base_x + (funge_cell)(i % SIDE), (funge_cell)((i / SIDE) % SIDE) };
+		fungespace_set('a' + (funge_cell)(i & 15), &pos);
+	}
+}
+
+static inline void set_random(size_t iterations, funge_cell base_x)
+{
+	for (size_t i = 0; i < iterations; i++) {
+		const funge_vector *r = &random_coords[i & (RANDOM_COUNT - 1)];
+		fungespace_set('a' + (funge_cell)(i & 15), &(funge_vector) { base_x + r->x, r->y });
+	}
+}
+
+static void bench_get_dense_seq(size_t n)  { get_sequential(n, 0); }
+static void bench_get_dense_rand(size_t n) { get_random(n, 0); }
+static void bench_get_hash_seq(size_t n)   { get_sequential(n, HASH_X); }
+static void bench_get_hash_rand(size_t n)  { get_random(n, HASH_X); }
+static void bench_set_dense_seq(size_t n)  { set_sequential(n, 0); }
+static void bench_set_dense_rand(size_t n) { set_random(n, 0); }
+static void bench_set_hash_seq(size_t n)   { set_sequential(n, HASH_X); }
+static void bench_set_hash_rand(size_t n)  { set_random(n, HASH_X); }
+
+/// Position just past the east edge, wrapped with the given delta.
+static inline void wrap_from_east(size_t iterations, funge_vector delta)
+{
+	fungeRect bounds;
+	funge_cell sum = 0;
+
+	fungespace_get_bounds_rect(&bounds);
+	for (size_t i = 0; i < iterations; i++) {
+		funge_vector pos = { bounds.x + bounds.w + 1, (funge_cell)(i % SIDE) };
+		fungespace_wrap(&pos, &delta);
+		sum += pos.x;
+	}
+	sink = sum;
+}
+
+static void bench_wrap_cardinal(size_t n) { wrap_from_east(n, (funge_vector) { 1, 0 }); }
+static void bench_wrap_flying(size_t n)   { wrap_from_east(n, (funge_vector) { 3, 1 }); }
+
+/**********
+ * Stacks *
+ **********/
+
+static funge_stack *bench_stack;
+
+static void bench_push_pop(size_t n)
+{
+	funge_cell sum = 0;
+	for (size_t i = 0; i < n; i++)
+		stack_push(bench_stack, (funge_cell)i);
+	for (size_t i = 0; i < n; i++)
+		sum += stack_pop(bench_stack);
+	sink = sum;
+}
+
+static void bench_dup_swap(size_t n)
+{
+	stack_push(bench_stack, 1);
+	stack_push(bench_stack, 2);
+	for (size_t i = 0; i < n; i++) {
+		stack_dup_top(bench_stack);
+		stack_swap_top(bench_stack);
+		stack_discard(bench_stack, 1);
+	}
+	sink = stack_pop(bench_stack) + stack_pop(bench_stack);
+}
+
+static const unsigned char bench_string[] = "The quick brown fox jumps over the lazy dog";
+
+static void bench_pop_string(size_t n)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++) {
+		unsigned char *str;
+		stack_push_string(bench_stack, bench_string, sizeof(bench_string) - 1);
+		str = stack_pop_string(bench_stack, &len);
+		stack_free_string(str);
+	}
+	sink = (funge_cell)len;
+}
+
+static void bench_pop_string_scratch(size_t n)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < n; i++) {
+		stack_push_string(bench_stack, bench_string, sizeof(bench_string) - 1);
+		if (!stack_pop_string_scratch(bench_stack, &len, 0))
+			abort();
+	}
+	sink = (funge_cell)len;
+}
+
+/*******
+ * IPs *
+ *******/
+
+#ifdef CONCURRENT_FUNGE
+static ipList *bench_iplist;
+
+static void bench_ip_split_terminate(size_t n)
+{
+	ssize_t sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		sum += iplist_duplicate_ip(&bench_iplist, 0);
+		sum += iplist_terminate_ip(&bench_iplist, 1);
+	}
+	sink = sum;
+}
+#endif
+
+/************
+ * Mempools *
+ ************/
+
+static void bench_mempool_alloc_free(size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		funge_stack *s = cf_mempool_stack_alloc();
+		sink = (funge_cell)(uintptr_t)s;
+		cf_mempool_stack_free(s);
+	}
+}
+
+/// Allocate 1024 blocks then free them, n is the total number of blocks.
+static void bench_mempool_batch(size_t n)
+{
+	static funge_stack *blocks[1024];
+	for (size_t done = 0; done < n; done += 1024) {
+		for (size_t i = 0; i < 1024; i++)
+			blocks[i] = cf_mempool_stack_alloc();
+		for (size_t i = 1024; i > 0; i--)
+			cf_mempool_stack_free(blocks[i - 1]);
+	}
+}
+
+static const microBench benchmarks[] = {
+	{ "fspace-get-dense-seq",   &bench_get_dense_seq,      1 << 22 },
+	{ "fspace-get-dense-rand",  &bench_get_dense_rand,     1 << 22 },
+	{ "fspace-get-hash-seq",    &bench_get_hash_seq,       1 << 20 },
+	{ "fspace-get-hash-rand",   &bench_get_hash_rand,      1 << 20 },
+	{ "fspace-set-dense-seq",   &bench_set_dense_seq,      1 << 22 },
+	{ "fspace-set-dense-rand",  &bench_set_dense_rand,     1 << 22 },
+	{ "fspace-set-hash-seq",    &bench_set_hash_seq,       1 << 20 },
+	{ "fspace-set-hash-rand",   &bench_set_hash_rand,      1 << 20 },
+	{ "fspace-wrap-cardinal",   &bench_wrap_cardinal,      1 << 22 },
+	{ "fspace-wrap-flying",     &bench_wrap_flying,        1 << 20 },
+	{ "stack-push-pop",         &bench_push_pop,           1 << 22 },
+	{ "stack-dup-swap",         &bench_dup_swap,           1 << 22 },
+	{ "stack-pop-string",       &bench_pop_string,         1 << 18 },
+	{ "stack-pop-string-scratch", &bench_pop_string_scratch, 1 << 18 },
+#ifdef CONCURRENT_FUNGE
+	{ "ip-split-terminate",     &bench_ip_split_terminate, 1 << 18 },
+#endif
+	{ "mempool-alloc-free",     &bench_mempool_alloc_free, 1 << 22 },
+	{ "mempool-batch",          &bench_mempool_batch,      1 << 22 },
+};
+
+static bool selected(const char *name, int argc, char *argv[])
+{
+	if (argc == 0)
+		return true;
+	for (int i = 0; i < argc; i++)
+		if (strstr(name, argv[i]))
+			return true;
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int repeats = 5;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+			case 'n':
+				repeats = atoi(optarg);
+				if (repeats < 1)
+					repeats = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n repeats] [substring...]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	setup_fungespace();
+	bench_stack = stack_create();
+	if (!bench_stack) {
+		perror("stack_create");
+		return EXIT_FAILURE;
+	}
+#ifdef CONCURRENT_FUNGE
+	bench_iplist = iplist_create();
+	if (!bench_iplist) {
+		perror("iplist_create");
+		return EXIT_FAILURE;
+	}
+#endif
+
+	printf("%-26s %12s %12s\n", "benchmark", "ns/iter", "cycles/iter");
+	for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+		const microBench *bench = &benchmarks[b];
+		uint64_t best_ns = UINT64_MAX, best_cycles = UINT64_MAX;
+
+		if (!selected(bench->name, argc - optind, argv + optind))
+			continue;
+		// Warm up caches and the mempools.
+		bench->run(bench->iterations / 16);
+		for (int r = 0; r < repeats; r++) {
+			uint64_t ns = read_ns();
+			uint64_t cycles = read_cycles();
+			bench->run(bench->iterations);
+			cycles = read_cycles() - cycles;
+			ns = read_ns() - ns;
+			if (ns < best_ns)
+				best_ns = ns;
+			if (cycles < best_cycles)
+				best_cycles = cycles;
+		}
+		printf("%-26s %12.2f %12.1f\n", bench->name,
+		       (double)best_ns / (double)bench->iterations,
+		       (double)best_cycles / (double)bench->iterations);
+		fflush(stdout);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+55*a*        v                  +------------------------+
+vp*9920p*9930<                  | Pi generator in Bef-97 |
+>:09a*pa*3/1+19a*p09a*g:09b*v   |                        |
+v_@# g*b90 p*b910        < p<   | 7/2/1997, Kevin Vigor  |
+>19a*g:+1-29b*p19a*g::09v       +------------------------+
+v*a90g*b90*g*b91: _v#p*9<
+>g-#v_ 2a*+\$  v  :$
+    >\1-aa*ga*+v  p
+v1:/g*b92p*991:<  *
+>9b*p29b*g*199*g\v9
+v*b92p*aa-1g*990-<9
+>g2-29b*p099*g1-:0^
+v -9p*b92:%ag*991  <
+>#v_ 299*g1+299*p>       ^
+  >09b*g:#v_$v
+v93p*b90-1<
+>9*g199*ga/+.v
+     v:g*992 <p*9 92-<
+    v_29b*g399*p ^
+    >09b*g:#v_v      1
+vp*b90-1    < $      g
+>199*g9`#v_'9,v      *
+         >'0, >' ,299^
@@ -0,0 +1,5 @@
+222paa*a*4*11p>133p                   >33g1+33p   22g33g- v>22g33g%#v_v
+ o                                                        >|
+  2                             v,,,,, ,,,,,.g22"is prime."<
+   1                            >    v^                             <
+              ^_@#-g11g22p22+1g22,*25<,,,,,,,,,,,,,.g22"is not prime."<
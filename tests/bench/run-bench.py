@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+###########################################################################
+#                                                                         #
+#  cfunge - A standard-conforming Befunge93/98/109 interpreter in C.      #
+#  Copyright (C) 2008-2013  Arvid Norlander                               #
+#                                                                         #
+#  This program is free software: you can redistribute it and/or modify   #
+#  it under the terms of the GNU General Public License as published by   #
+#  the Free Software Foundation, either version 3 of the License, or      #
+#  (at the proxy's option) any later version. Arvid Norlander is a        #
+#  proxy who can decide which future versions of the GNU General Public   #
+#  License can be used.                                                   #
+#                                                                         #
+#  This program is distributed in the hope that it will be useful,        #
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of         #
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          #
+#  GNU General Public License for more details.                           #
+#                                                                         #
+#  You should have received a copy of the GNU General Public License      #
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.  #
+#                                                                         #
+###########################################################################
+
+"""Benchmark harness for cfunge.
+
+Runs each workload a number of times and reports the mean wall time with a
+95% confidence interval, plus instructions per second when the instruction
+count is known. Results can be saved as a baseline JSON file, and later runs
+compared against it to flag regressions.
+"""
+
+import argparse
+import json
+import math
+import os
+import os.path
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+_SUFFIX_MAP = {
+    'b98': '98',
+    'bf': '93',
+}
+
+_BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+_EXAMPLES_DIR = os.path.join(_BENCH_DIR, '..', '..', 'examples')
+
+# name, program, extra options. A workload with 'output_limit' is stopped
+# after printing that many bytes (life.bf never ends by itself), and has no
+# instruction count.
+WORKLOADS = [
+    {'name': 'arith', 'file': 'arith.b98'},
+    {'name': 'selfmod', 'file': 'selfmod.b98'},
+    {'name': 'sparse', 'file': 'sparse.b98'},
+    {'name': 'strings', 'file': 'strings.b98'},
+    {'name': 'concurrent', 'file': 'concurrent.b98', 'needs': '+con'},
+    {'name': 'file-io', 'file': 'file-io.b98'},
+    # Copies of examples/pi2.bf and examples/prime.bf, with the number of
+    # digits and the upper limit raised.
+    {'name': 'pi2', 'file': 'pi2-250.bf'},
+    {'name': 'prime', 'file': 'prime-4000.bf'},
+    {'name': 'life', 'file': os.path.join(_EXAMPLES_DIR, 'life.bf'),
+     'output_limit': 150000},
+]
+
+# Two sided 95% t-distribution quantiles by degrees of freedom.
+_T95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+        2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+        2.048, 2.045, 2.042]
+
+_INSTRUCTIONS_RE = re.compile(
+    rb'Instructions:\s+(\d+)(?: \(plus (\d+) cells in string mode\))?')
+
+
+def confidence_interval(samples):
+    """Half width of the 95% confidence interval of the mean"""
+    if len(samples) < 2:
+        return 0.0
+    df = len(samples) - 1
+    t = _T95[df - 1] if df <= len(_T95) else 1.96
+    return t * statistics.stdev(samples) / math.sqrt(len(samples))
+
+
+def command_for(cfunge, workload, extra=()):
+    """Build the command line for a workload"""
+    path = workload['file']
+    if not os.path.isabs(path):
+        path = os.path.join(_BENCH_DIR, path)
+    return [cfunge, '-s', _SUFFIX_MAP[path.split('.')[-1]]] + list(extra) + [path]
+
+
+def run_once(command, workload, workdir):
+    """Run a workload, return wall time in seconds and stderr"""
+    limit = workload.get('output_limit')
+    start = time.perf_counter()
+    if limit is None:
+        result = subprocess.run(command, cwd=workdir, stdin=subprocess.DEVNULL,
+                                stdout=subprocess.DEVNULL,
+                                stderr=subprocess.PIPE, check=False)
+        elapsed = time.perf_counter() - start
+        if result.returncode != 0:
+            raise RuntimeError('%s exited with %d' % (workload['name'], result.returncode))
+        return elapsed, result.stderr
+    with subprocess.Popen(command, cwd=workdir, stdin=subprocess.DEVNULL,
+                          stdout=subprocess.PIPE,
+                          stderr=subprocess.DEVNULL) as process:
+        remaining = limit
+        while remaining > 0:
+            data = process.stdout.read1(remaining)
+            if not data:
+                raise RuntimeError('%s ended before printing %d bytes' % (workload['name'], limit))
+            remaining -= len(data)
+        elapsed = time.perf_counter() - start
+        process.kill()
+    return elapsed, b''
+
+
+def count_instructions(cfunge, workload, workdir):
+    """Count instructions with a binary built with ENABLE_STATS, or None"""
+    if cfunge is None or 'output_limit' in workload:
+        return None
+    unused, stderr = run_once(command_for(cfunge, workload, ['-x']), workload, workdir)
+    match = _INSTRUCTIONS_RE.search(stderr)
+    if not match:
+        return None
+    return int(match.group(1)) + int(match.group(2) or 0)
+
+
+def build_flags(cfunge):
+    """The [+con ...] part of cfunge -v"""
+    output = subprocess.run([cfunge, '-v'], stdout=subprocess.PIPE,
+                            check=True).stdout.decode('utf-8', 'replace')
+    first_line = output.splitlines()[0] if output else ''
+    return first_line, set(re.findall(r'[-+][\w-]+', first_line))
+
+
+def format_rate(instructions, mean):
+    """Millions of instructions per second, or a dash"""
+    if not instructions:
+        return '-'
+    return '%.1f' % (instructions / mean / 1e6)
+
+
+def main():
+    """Main function"""
+    parser = argparse.ArgumentParser(description='Benchmark harness for cfunge')
+    parser.add_argument('cfunge_path',
+                        help='Path to cfunge')
+    parser.add_argument('-n', '--repeat',
+                        default=5,
+                        type=int,
+                        help='Timed runs per workload (default: 5)')
+    parser.add_argument('--warmup',
+                        default=1,
+                        type=int,
+                        help='Untimed runs before timing (default: 1)')
+    parser.add_argument('--filter',
+                        default=None,
+                        help='Only run workloads matching this regex')
+    parser.add_argument('--stats-cfunge',
+                        default=None,
+                        help='cfunge built with ENABLE_STATS, used to count '
+                             'instructions (default: cfunge_path if it has stats)')
+    parser.add_argument('--baseline',
+                        default=None,
+                        help='Compare against this baseline JSON file, if it exists')
+    parser.add_argument('--save-baseline',
+                        default=None,
+                        help='Write results to this baseline JSON file')
+    parser.add_argument('--threshold',
+                        default=0.05,
+                        type=float,
+                        help='Relative slowdown flagged as a regression, if the '
+                             'confidence intervals do not overlap (default: 0.05)')
+    args = parser.parse_args()
+
+    cfunge = os.path.abspath(args.cfunge_path)
+    version, flags = build_flags(cfunge)
+    stats_cfunge = args.stats_cfunge
+    if stats_cfunge is not None:
+        stats_cfunge = os.path.abspath(stats_cfunge)
+    if stats_cfunge is None and '+stats' in flags:
+        stats_cfunge = cfunge
+
+    baseline = {}
+    if args.baseline and os.path.exists(args.baseline):
+        with open(args.baseline, mode='r') as f:
+            baseline = json.load(f).get('workloads', {})
+
+    print(version)
+    print('%-12s %10s %9s %10s %10s %8s' % ('workload', 'mean (s)', '95% CI', 'Minstr/s', 'baseline', 'change'))
+    results = {}
+    regressions = []
+    with tempfile.TemporaryDirectory(prefix='cfunge-bench-') as workdir:
+        for workload in WORKLOADS:
+            name = workload['name']
+            if args.filter and not re.search(args.filter, name):
+                continue
+            if workload.get('needs') and workload['needs'] not in flags:
+                print('%-12s skipped, cfunge was built without %s' % (name, workload['needs']))
+                continue
+            command = command_for(cfunge, workload)
+            for unused in range(args.warmup):
+                run_once(command, workload, workdir)
+            samples = [run_once(command, workload, workdir)[0] for unused in range(args.repeat)]
+            mean = statistics.mean(samples)
+            ci = confidence_interval(samples)
+            instructions = count_instructions(stats_cfunge, workload, workdir)
+            if instructions is None and name in baseline:
+                instructions = baseline[name].get('instructions')
+            results[name] = {'mean': mean, 'ci': ci, 'runs': samples,
+                             'instructions': instructions}
+
+            base = baseline.get(name)
+            base_text, change_text, flag = '-', '-', ''
+            if base:
+                change = mean / base['mean'] - 1
+                base_text = '%.4f' % base['mean']
+                change_text = '%+.1f%%' % (change * 100)
+                if change > args.threshold and mean - ci > base['mean'] + base['ci']:
+                    flag = '  REGRESSION'
+                    regressions.append(name)
+            print('%-12s %10.4f %9.4f %10s %10s %8s%s' % (name, mean, ci,
+                  format_rate(instructions, mean), base_text, change_text, flag))
+            sys.stdout.flush()
+
+    if args.save_baseline:
+        with open(args.save_baseline, mode='w') as f:
+            json.dump({'cfunge': version, 'workloads': results}, f, indent=2, sort_keys=True)
+            f.write('\n')
+    if regressions:
+        print('Regressions: %s' % ', '.join(regressions), file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
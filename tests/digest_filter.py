@@ -0,0 +1,16 @@
+#!/usr/bin/python3
+"""Output filter for test_runner.py, for output too large for an .expected
+file: print its length and SHA-256 digest instead"""
+
+import hashlib
+import sys
+
+
+def main():
+    """Main function"""
+    data = sys.stdin.buffer.read()
+    sys.stdout.write('%d %s\n' % (len(data), hashlib.sha256(data).hexdigest()))
+
+
+if __name__ == '__main__':
+    main()
@@ -4,6 +4,7 @@
 import argparse
 import os
 import os.path
+import re
 import sys
 import subprocess
 
@@ -67,26 +68,65 @@ def main():
                         default=0,
                         type=int,
                         help='Expected exit code (default: 0)')
+    parser.add_argument('--pipe-input',
+                        action='store_true',
+                        help='Feed the .input file through a pipe instead of as a file')
+    parser.add_argument('--cfunge-arg',
+                        action='append',
+                        default=[],
+                        help='Extra argument to pass to cfunge (may be repeated)')
+    parser.add_argument('--stderr-pattern',
+                        default=None,
+                        help='Regular expression that must match what cfunge writes to stderr')
+    parser.add_argument('--output-file',
+                        action='append',
+                        default=[],
+                        help='File cfunge writes, compared against <test>.<file>.expected (may be repeated)')
     args = parser.parse_args()
     test = args.test_file
     test_extension = test.split('.')[-1]
     expected_file_path_base = '.'.join(test.split('.')[:-1])
     ret_code = 0
     output = b''
+    errors = b''
+    # Tests reading input have it in a .input file.
+    input_file_path = expected_file_path_base + '.input'
+    stdin = None
+    input_args = {}
+    if os.path.exists(input_file_path):
+        if args.pipe_input:
+            with open(input_file_path, mode='rb') as input_file:
+                input_args['input'] = input_file.read()
+        else:
+            stdin = open(input_file_path, mode='rb')
+            input_args['stdin'] = stdin
+    if args.stderr_pattern is not None:
+        input_args['stderr'] = subprocess.PIPE
     try:
-        output = subprocess.check_output([args.cfunge_path,
-                                          '-s', _SUFFIX_MAP[test_extension],
-                                          test],
-                                         env={'TEST_ENV': 'test'})
-    except subprocess.CalledProcessError as e:
-        ret_code = e.returncode
-        output = e.output
+        result = subprocess.run([args.cfunge_path,
+                                 '-s', _SUFFIX_MAP[test_extension]] +
+                                args.cfunge_arg +
+                                [test],
+                                stdout=subprocess.PIPE,
+                                **input_args,
+                                env={'TEST_ENV': 'test'})
+        ret_code = result.returncode
+        output = result.stdout
+        errors = result.stderr or b''
+    finally:
+        if stdin is not None:
+            stdin.close()
 
     success = True
 
     if ret_code != args.exit_code:
         print("Incorrect exit code %r (expected %r)" % (ret_code, args.exit_code), file=sys.stderr)
 
+    if args.stderr_pattern is not None and not re.search(args.stderr_pattern.encode(), errors):
+        print("Stderr does not match %r:" % args.stderr_pattern, file=sys.stderr)
+        print(errors, file=sys.stderr)
+        success = False
+
     with open(expected_file_path_base + '.expected', mode='rb') as expected_file:
         success = compare_contents("Output",
                                    expected_file.read(),
@@ -99,6 +139,14 @@ def main():
                                        expected_file.read(),
                                        actual_file.read(),
                                        args.test_filter) and success
+    for name in args.output_file:
+        with open(expected_file_path_base + '.' + name + '.expected', mode='rb') as expected_file, \
+             open(name, mode='rb') as actual_file:
+            success = compare_contents(name,
+                                       expected_file.read(),
+                                       actual_file.read(),
+                                       None) and success
+        os.unlink(name)
     cleanup()
     if success:
         sys.exit(0)
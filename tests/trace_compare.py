@@ -0,0 +1,54 @@
+#!/usr/bin/python3
+"""Check that tools/trace-decode.py turns a -T trace into exactly what -t 4
+prints for the same program"""
+
+import argparse
+import os.path
+import subprocess
+import sys
+
+_DECODER = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        '..', 'tools', 'trace-decode.py')
+
+
+def main():
+    """Main function"""
+    parser = argparse.ArgumentParser(description='Compare -T and -t 4 traces')
+    parser.add_argument('cfunge_path',
+                        help='Path to cfunge')
+    parser.add_argument('test_file',
+                        help='Path to test file')
+    parser.add_argument('--ring',
+                        type=int,
+                        default=0,
+                        help='Pass -K to cfunge, only the last records are compared')
+    args = parser.parse_args()
+
+    text = subprocess.run([args.cfunge_path, '-t', '4', args.test_file],
+                          stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE,
+                          check=True).stderr
+    binary_args = ['-T', 'trace.bin']
+    if args.ring:
+        binary_args += ['-K', str(args.ring)]
+    subprocess.run([args.cfunge_path] + binary_args + [args.test_file],
+                   stdout=subprocess.DEVNULL,
+                   check=True)
+    decoded = subprocess.run([sys.executable, _DECODER, 'trace.bin'],
+                             stdout=subprocess.PIPE,
+                             check=True).stdout
+    os.unlink('trace.bin')
+
+    expected = text.splitlines(keepends=True)
+    if args.ring:
+        expected = expected[-args.ring:]
+    if b''.join(expected) != decoded:
+        print("Expected trace:", file=sys.stderr)
+        print(b''.join(expected), file=sys.stderr)
+        print("Decoded trace:", file=sys.stderr)
+        print(decoded, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+###########################################################################
+#                                                                         #
+#  cfunge - A standard-conforming Befunge93/98/109 interpreter in C.      #
+#  Copyright (C) 2008-2013  Arvid Norlander                               #
+#                                                                         #
+#  This program is free software: you can redistribute it and/or modify   #
+#  it under the terms of the GNU General Public License as published by   #
+#  the Free Software Foundation, either version 3 of the License, or      #
+#  (at the proxy's option) any later version. Arvid Norlander is a        #
+#  proxy who can decide which future versions of the GNU General Public   #
+#  License can be used.                                                   #
+#                                                                         #
+#  This program is distributed in the hope that it will be useful,        #
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of         #
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          #
+#  GNU General Public License for more details.                           #
+#                                                                         #
+#  You should have received a copy of the GNU General Public License      #
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.  #
+#                                                                         #
+###########################################################################
+
+# Decode a binary trace written by cfunge -T into the text format of -t.
+# See src/trace.h for the file format.
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"CFTRACE1"
+FLAG_RING = 0x1
+FLAG_CONCURRENT = 0x2
+# x, y, opcode, tos, id, depth, tix
+RECORD = "qqqqqIi"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Print a cfunge -T trace in the same format as -t.")
+    parser.add_argument("file", help="trace file written by cfunge -T")
+    parser.add_argument("-l", "--level", type=int, default=4,
+                        help="trace level to imitate: 3 (opcodes only), 4 "
+                             "(default) or 9 (with top of stack)")
+    parser.add_argument("-i", "--ip", type=int, action="append",
+                        help="only show this IP ID (may be repeated)")
+    parser.add_argument("-r", "--region", metavar="X1,Y1,X2,Y2",
+                        help="only show instructions inside this rectangle "
+                             "(inclusive)")
+    parser.add_argument("-o", "--opcode", metavar="CHARS",
+                        help="only show these instructions")
+    return parser.parse_args()
+
+
+def read_records(f):
+    header = f.read(16)
+    if len(header) != 16 or header[:8] != MAGIC:
+        sys.exit("Not a cfunge trace file.")
+    for order in "<>":
+        size, flags = struct.unpack(order + "II", header[8:])
+        record = struct.Struct(order + RECORD)
+        if size == record.size:
+            break
+    else:
+        sys.exit("Unknown record size, trace from a newer cfunge?")
+    while True:
+        data = f.read(record.size * 4096)
+        if not data:
+            break
+        usable = len(data) - len(data) % record.size
+        yield from record.iter_unpack(data[:usable])
+        if usable != len(data):
+            # Process died in the middle of a write.
+            break
+
+
+def main():
+    args = parse_args()
+    region = None
+    if args.region:
+        region = [int(v) for v in args.region.split(",")]
+        if len(region) != 4:
+            sys.exit("--region needs four numbers.")
+    opcodes = None
+    if args.opcode:
+        opcodes = set(ord(c) for c in args.opcode)
+    ips = set(args.ip) if args.ip else None
+
+    out = sys.stdout.buffer
+    with open(args.file, "rb") as f:
+        for x, y, opcode, tos, ipid, depth, tix in read_records(f):
+            if ips is not None and ipid not in ips:
+                continue
+            if region and not (region[0] <= x <= region[2] and region[1] <= y <= region[3]):
+                continue
+            if opcodes is not None and opcode not in opcodes:
+                continue
+            char = bytes([opcode & 0xff])
+            if args.level <= 3:
+                out.write(char)
+                continue
+            if tix >= 0:
+                prefix = b"tix=%d tid=%d " % (tix, ipid)
+            else:
+                prefix = b""
+            out.write(prefix + b"x=%d y=%d: %s (%d)\n" % (x, y, char, opcode))
+            if args.level > 8:
+                # Only the top is recorded, -t shows up to 15 elements.
+                if depth == 0:
+                    out.write(b"\tStack is empty.\n")
+                else:
+                    out.write(b"\tStack has %d elements, top element:\n\t\t%d \n" % (depth, tos))
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except BrokenPipeError:
+        sys.stderr.close()